@@ -0,0 +1,386 @@
+/*
+ * benchmark.cpp
+ * msgpack_test
+ *
+ * pack/unpack throughput over a range of message shapes.
+ * For every shape it reports MB/s, messages/s and heap allocations per message,
+ * for both the map and the positional array encoding,
+ * next to netLink's generic MsgPack::Element encoder/decoder as the reference.
+ *
+ * The batch section packs and unpacks 10000 ObjectA records at a time on 1..N threads,
+ * and with C++17 also unpacks them into pmr members on per-worker arenas. Its rows are per record.
+ * The last section reports ns per number for the int64/double vectors and the byte swap.
+ *
+ * usage: benchmark [megabytes per case (default 64)]
+ */
+
+#include "ca_msgpack.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> allocations(0);
+
+// kept out of line so that GCC does not pair the inlined malloc/free with new/delete
+#if defined(__GNUC__)
+#define BENCHMARK_NOINLINE __attribute__((noinline))
+#else
+#define BENCHMARK_NOINLINE
+#endif
+
+BENCHMARK_NOINLINE void* operator new(size_t size) {
+	allocations++;
+	if (void* p = malloc(size)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+BENCHMARK_NOINLINE void operator delete(void* p) noexcept {
+	free(p);
+}
+BENCHMARK_NOINLINE void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+// sample.cpp
+struct ObjectB {
+	int integer;
+	std::string string;
+	CA_MSGPACK(integer, string);
+};
+
+struct ObjectA {
+	int integer;
+	bool boolean;
+	std::string string;
+	ObjectB objectB;
+	std::vector<std::string> stringArray;
+	std::map<std::string, std::string> stringMap;
+	std::vector<ObjectB> objectBArray;
+	std::map<std::string, ObjectB> objectBMap;
+	CA_MSGPACK(integer, boolean, string, objectB, stringArray, stringMap, objectBArray, objectBMap);
+};
+
+#ifdef CA_MSGPACK_PMR
+// ObjectA with every allocating member on a std::pmr resource
+struct PmrObjectB {
+	int integer;
+	std::pmr::string string;
+	CA_MSGPACK(integer, string);
+};
+
+struct PmrObjectA {
+	int integer;
+	bool boolean;
+	std::pmr::string string;
+	PmrObjectB objectB;
+	std::pmr::vector<std::pmr::string> stringArray;
+	std::pmr::map<std::pmr::string, std::pmr::string> stringMap;
+	std::pmr::vector<PmrObjectB> objectBArray;
+	std::pmr::map<std::pmr::string, PmrObjectB> objectBMap;
+	CA_MSGPACK(integer, boolean, string, objectB, stringArray, stringMap, objectBArray, objectBMap);
+};
+#endif
+
+// flat scalar struct
+struct Flat {
+	int32_t i32;
+	uint32_t u32;
+	int64_t i64;
+	uint64_t u64;
+	float f;
+	double d;
+	bool b;
+	std::string s;
+	CA_MSGPACK(i32, u32, i64, u64, f, d, b, s);
+};
+
+// deeply nested objects
+struct Leaf {
+	int32_t value;
+	std::string name;
+	CA_MSGPACK(value, name);
+};
+
+template <class Child>
+struct Nest {
+	Child child;
+	int32_t depth;
+	CA_MSGPACK(child, depth);
+};
+
+typedef Nest<Nest<Nest<Nest<Nest<Nest<Nest<Nest<Leaf> > > > > > > > Nested;
+
+struct StringArray {
+	std::vector<std::string> strings;
+	CA_MSGPACK(strings);
+};
+
+struct StringMap {
+	std::map<std::string, int32_t> values;
+	CA_MSGPACK(values);
+};
+
+struct Numbers {
+	std::vector<int64_t> integers;
+	std::vector<double> doubles;
+	CA_MSGPACK(integers, doubles);
+};
+
+// byte-by-byte swap EndianUtil::change used before the intrinsics
+template <class T>
+static T legacyChange(T in) {
+	T out;
+	for (unsigned i = 0; i < sizeof(T); i++) {
+		((char*)&out)[i] = ((char*)&in)[sizeof(T)-i-1];
+	}
+	return out;
+}
+
+static size_t megabytes = 64;
+
+// func handles messages messages of messageSize bytes in total per call; returns ns per call
+template <class F>
+static double run(const char* shape, const char* op, size_t messageSize, F func, size_t messages = 1) {
+	size_t count = std::max((size_t)1, (megabytes << 20) / messageSize);
+	func();
+	size_t allocationsBefore = allocations;
+	auto begin = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; i++) {
+		func();
+	}
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(end - begin).count();
+	printf("%-10s %-16s %10.1f MB/s %12.0f msg/s %10.1f allocs/msg\n", shape, op,
+		(double)messageSize * count / seconds / (1 << 20), (double)count * messages / seconds,
+		(double)(allocations - allocationsBefore) / count / messages);
+	return seconds * 1e9 / count;
+}
+
+static void perNumber(const char* shape, const char* op, double ns, size_t numbers) {
+	printf("%-10s %-16s %10.2f ns/number\n", shape, op, ns / numbers);
+}
+
+template <class T>
+static void bench(const char* shape, const T& obj) {
+	std::string packed;
+	{
+		ca_msgpack::Writer writer(packed);
+		obj.pack(writer);
+	}
+	std::string buffer;
+	run(shape, "pack", packed.size(), [&]() {
+		buffer.clear();
+		ca_msgpack::Writer writer(buffer);
+		obj.pack(writer);
+	});
+	run(shape, "unpack", packed.size(), [&]() {
+		T out;
+		out.unpack(packed.data(), packed.size());
+	});
+	run(shape, "validate", packed.size(), [&]() {
+		if (ca_msgpack::validate(packed.data(), packed.size()) != packed.size()) {
+			abort();
+		}
+	});
+	run(shape, "unpack stream", packed.size(), [&]() {
+		T out;
+		std::stringbuf sb(packed);
+		out.unpack(&sb);
+	});
+
+	// positional encoding: same fields as arrays, without the key strings
+	std::string positional;
+	{
+		ca_msgpack::Writer writer(positional);
+		writer.setPositional(true);
+		obj.pack(writer);
+	}
+	printf("%-10s %-16s %10zu bytes map %8zu bytes array (%.0f%%)\n", shape, "size", packed.size(), positional.size(),
+		100.0 * positional.size() / packed.size());
+	run(shape, "pack array", positional.size(), [&]() {
+		buffer.clear();
+		ca_msgpack::Writer writer(buffer);
+		writer.setPositional(true);
+		obj.pack(writer);
+	});
+	run(shape, "unpack array", positional.size(), [&]() {
+		T out;
+		out.unpack(positional.data(), positional.size());
+	});
+
+	// one long-lived writer and reader over a log of records
+	std::stringbuf log;
+	{
+		ca_msgpack::StreamWriter<T> writer(&log);
+		run(shape, "stream write", packed.size(), [&]() {
+			writer.write(obj);
+		});
+	}
+	{
+		ca_msgpack::StreamReader<T> reader(&log);
+		T out;
+		run(shape, "stream read", packed.size(), [&]() {
+			if (!reader.read(out)) {
+				abort();
+			}
+		});
+	}
+
+	// reference: netLink's generic element tree
+	ca_msgpack::Element element;
+	{
+		std::stringbuf sb(packed);
+		MsgPack::Deserializer deserializer(&sb);
+		deserializer.deserialize(element, true);
+	}
+	run(shape, "netLink encode", packed.size(), [&]() {
+		std::stringbuf sb;
+		MsgPack::Serializer serializer(&sb);
+		serializer << element;
+	});
+	run(shape, "netLink decode", packed.size(), [&]() {
+		std::stringbuf sb(packed);
+		MsgPack::Deserializer deserializer(&sb);
+		ca_msgpack::Element out;
+		deserializer.deserialize(out, true);
+	});
+}
+
+int main(int argc, const char * argv[]) {
+	if (argc >= 2) {
+		megabytes = atoi(argv[1]);
+	}
+
+	ObjectA objectA = {
+		12,
+		true,
+		"foo",
+		ObjectB{ 52, "bar" },
+		std::vector<std::string>{ "baz1", "baz2", "baz3" },
+		std::map<std::string, std::string>{ { "key1", "value1" }, { "key2", "value2" } },
+		std::vector<ObjectB>{ { 111, "xxx" }, { 222, "yyy" } },
+		std::map<std::string, ObjectB>{ { "111", { 111, "xxx" } }, { "222", { 222, "yyy" } } }
+	};
+	bench("ObjectA", objectA);
+	bench("ObjectB", objectA.objectB);
+
+	// two fields of ObjectA through a lazy view, against the full unpack above
+	std::string packedA;
+	{
+		ca_msgpack::Writer writer(packedA);
+		objectA.pack(writer);
+	}
+	volatile int fields = 0;
+	run("ObjectA", "view 2 fields", packedA.size(), [&]() {
+		ca_msgpack::View<ObjectA> view(packedA.data(), packedA.size());
+		int integer = 0;
+		ObjectB objectB;
+		view.get(&ObjectA::integer, integer);
+		view.find(&ObjectA::objectBMap, "222", 3, objectB);
+		fields = fields + integer + objectB.integer;
+	});
+
+	Flat flat = { -12345, 12345, -1234567890123LL, 1234567890123ULL, 1.5f, 2.25, true, "flat" };
+	bench("flat", flat);
+
+	Nested nested;
+	nested.child.child.child.child.child.child.child.child.value = 42;
+	nested.child.child.child.child.child.child.child.child.name = "leaf";
+	bench("nested", nested);
+
+	StringArray strings;
+	for (int i = 0; i < 1000; i++) {
+		strings.strings.push_back(std::string(64, (char)('a' + i % 26)));
+	}
+	bench("strings", strings);
+
+	StringMap map;
+	for (int i = 0; i < 1000; i++) {
+		map.values["key" + std::to_string(i)] = i;
+	}
+	bench("map", map);
+
+	Numbers numbers;
+	for (int i = 0; i < 100000; i++) {
+		numbers.integers.push_back((int64_t)i * 1000003);
+		numbers.doubles.push_back(i * 0.5);
+	}
+	bench("numbers", numbers);
+
+	// batch scaling over worker threads
+	std::vector<ObjectA> records(10000, objectA);
+	for (size_t i = 0; i < records.size(); i++) {
+		records[i].integer = (int)i;
+	}
+	std::vector<ObjectA> decoded(records.size());
+	size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+	for (size_t threads = 1; threads <= cores; threads = threads < cores ? std::min(threads * 2, cores) : cores + 1) {
+		ca_msgpack::Batch batch(threads);
+		std::string output;
+		std::vector<uint64_t> offsets;
+		batch.pack(records.data(), records.size(), output, offsets);
+		char op[32];
+		snprintf(op, sizeof(op), "pack x%zu", threads);
+		run("batch", op, output.size(), [&]() {
+			batch.pack(records.data(), records.size(), output, offsets);
+		}, records.size());
+		snprintf(op, sizeof(op), "unpack x%zu", threads);
+		run("batch", op, output.size(), [&]() {
+			batch.unpack(output.data(), offsets.data(), decoded.data(), decoded.size());
+		}, records.size());
+#ifdef CA_MSGPACK_PMR
+		// the same records into pmr members on per-worker arenas, released after every batch
+		batch.setArenas(true);
+		snprintf(op, sizeof(op), "unpack arena x%zu", threads);
+		run("batch", op, output.size(), [&]() {
+			{
+				std::vector<PmrObjectA> arenaDecoded(records.size());
+				batch.unpack(output.data(), offsets.data(), arenaDecoded.data(), arenaDecoded.size());
+			}
+			batch.releaseArenas();
+		}, records.size());
+#endif
+	}
+
+	// per-number cost of pack/unpack and of the byte swap
+	const size_t numberCount = numbers.integers.size();
+	std::string packedNumbers;
+	{
+		ca_msgpack::Writer writer(packedNumbers);
+		numbers.pack(writer);
+	}
+	std::string numberBuffer;
+	double ns = run("numbers", "pack", packedNumbers.size(), [&]() {
+		numberBuffer.clear();
+		ca_msgpack::Writer writer(numberBuffer);
+		numbers.pack(writer);
+	});
+	perNumber("numbers", "pack", ns, numberCount * 2);
+	ns = run("numbers", "unpack", packedNumbers.size(), [&]() {
+		Numbers out;
+		out.unpack(packedNumbers.data(), packedNumbers.size());
+	});
+	perNumber("numbers", "unpack", ns, numberCount * 2);
+	volatile uint64_t sink = 0;
+	ns = run("swap", "legacy", numberCount * sizeof(uint64_t), [&]() {
+		uint64_t sum = 0;
+		for (size_t i = 0; i < numberCount; i++) {
+			sum += legacyChange((uint64_t)numbers.integers[i]);
+		}
+		sink = sink + sum;
+	});
+	perNumber("swap", "legacy", ns, numberCount);
+	ns = run("swap", "intrinsic", numberCount * sizeof(uint64_t), [&]() {
+		uint64_t sum = 0;
+		for (size_t i = 0; i < numberCount; i++) {
+			sum += ca_msgpack::EndianUtil::change((uint64_t)numbers.integers[i]);
+		}
+		sink = sink + sum;
+	});
+	perNumber("swap", "intrinsic", ns, numberCount);
+
+	return 0;
+}
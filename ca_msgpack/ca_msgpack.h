@@ -9,449 +9,2573 @@
 #ifndef msgpack_test_ca_msgpack_h
 #define msgpack_test_ca_msgpack_h
 
-#define BOOST_PP_VARIADICS 1
-
 #include "MsgPack.h"
 #include <iostream>
 #include <vector>
+#include <array>
 #include <map>
-#include <boost/preprocessor/cat.hpp>
-#include <boost/preprocessor/variadic/size.hpp>
+#include <unordered_map>
+#include <tuple>
+#include <chrono>
+#include <new>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+#ifdef CA_MSGPACK_INSTRUMENT
+#include <atomic>
+#include <mutex>
+#include <typeinfo>
+#if defined(__GNUG__)
+#define CA_MSGPACK_DEMANGLE 1
+#include <cstdlib>
+#include <cxxabi.h>
+#endif
+#ifndef CA_MSGPACK_INSTRUMENT_MAX_TYPES
+#define CA_MSGPACK_INSTRUMENT_MAX_TYPES 256
+#endif
+#endif
+#include <cstring>
+#include <cctype>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <memory>
+
+#if __cplusplus >= 201703L
+#define CA_MSGPACK_CXX17 1
+#include <string_view>
+#include <optional>
+#if __has_include(<memory_resource>)
+#define CA_MSGPACK_PMR 1
+#include <memory_resource>
+#endif
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CA_MSGPACK_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define CA_MSGPACK_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CA_MSGPACK_MMAP 1
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace ca_msgpack {
 
 	typedef std::unique_ptr<MsgPack::Element> Element;
 
+#ifdef CA_MSGPACK_PMR
+	typedef std::pmr::memory_resource MemoryResource;
+#else
+	class MemoryResource;
+#endif
+
 	class EndianUtil {
 	private:
 		EndianUtil();
+		template <size_t N> struct Unsigned;
+		static uint8_t swap(uint8_t in) {
+			return in;
+		}
+#if defined(__GNUC__) || defined(__clang__)
+		static uint16_t swap(uint16_t in) {
+			return __builtin_bswap16(in);
+		}
+		static uint32_t swap(uint32_t in) {
+			return __builtin_bswap32(in);
+		}
+		static uint64_t swap(uint64_t in) {
+			return __builtin_bswap64(in);
+		}
+#elif defined(_MSC_VER)
+		static uint16_t swap(uint16_t in) {
+			return _byteswap_ushort(in);
+		}
+		static uint32_t swap(uint32_t in) {
+			return _byteswap_ulong(in);
+		}
+		static uint64_t swap(uint64_t in) {
+			return _byteswap_uint64(in);
+		}
+#else
+		static uint16_t swap(uint16_t in) {
+			return (uint16_t)((in << 8) | (in >> 8));
+		}
+		static uint32_t swap(uint32_t in) {
+			return ((uint32_t)swap((uint16_t)in) << 16) | swap((uint16_t)(in >> 16));
+		}
+		static uint64_t swap(uint64_t in) {
+			return ((uint64_t)swap((uint32_t)in) << 32) | swap((uint32_t)(in >> 32));
+		}
+#endif
 	public:
+		// converts between host byte order and the big-endian wire order
 		template <class T>
 		static T change(T in) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			return in;
+#else
+			typename Unsigned<sizeof(T)>::type bits;
+			memcpy(&bits, &in, sizeof(T));
+			bits = swap(bits);
 			T out;
-			for (unsigned i = 0; i < sizeof(T); i++) {
-				((char*)&out)[i] = ((char*)&in)[sizeof(T)-i-1];
-			}
+			memcpy(&out, &bits, sizeof(T));
 			return out;
+#endif
 		}
 	};
+	template <> struct EndianUtil::Unsigned<1> { typedef uint8_t type; };
+	template <> struct EndianUtil::Unsigned<2> { typedef uint16_t type; };
+	template <> struct EndianUtil::Unsigned<4> { typedef uint32_t type; };
+	template <> struct EndianUtil::Unsigned<8> { typedef uint64_t type; };
 
 	class MsgPackError {
 	};
 
+	// wire format MapSerializer uses for each number type
+	template <class T> struct NumberFormat {
+		static constexpr bool enabled = false;
+	};
+#define __CAMP_NUMBER_FORMAT__(T, W, t) \
+	template <> struct NumberFormat<T> { \
+		static constexpr bool enabled = true; \
+		static constexpr uint8_t type = t; \
+		typedef W Wire; \
+	};
+	__CAMP_NUMBER_FORMAT__(int32_t, int64_t, 0xd3)
+	__CAMP_NUMBER_FORMAT__(uint32_t, uint64_t, 0xcf)
+	__CAMP_NUMBER_FORMAT__(int64_t, int64_t, 0xd3)
+	__CAMP_NUMBER_FORMAT__(uint64_t, uint64_t, 0xcf)
+	__CAMP_NUMBER_FORMAT__(float, float, 0xca)
+	__CAMP_NUMBER_FORMAT__(double, double, 0xcb)
+#undef __CAMP_NUMBER_FORMAT__
+
+	// Borrowed byte range, encoded as bin 8/16/32.
+	// A BytesView (or std::string_view) member filled by unpack(const char*, size_t) or
+	// unpack(Reader&) points into the input buffer, which must stay alive and unmodified
+	// for as long as the member is used. Streaming unpack overloads decode from a
+	// temporary buffer and throw MsgPackError for such members.
+	class BytesView {
+	private:
+		const char* _data;
+		size_t _size;
+	public:
+		BytesView() : _data(NULL), _size(0) {
+		}
+		BytesView(const char* data, size_t size) : _data(data), _size(size) {
+		}
+		const char* data() const {
+			return _data;
+		}
+		size_t size() const {
+			return _size;
+		}
+		bool empty() const {
+			return _size == 0;
+		}
+		const char* begin() const {
+			return _data;
+		}
+		const char* end() const {
+			return _data + _size;
+		}
+	};
+
+#ifdef CA_MSGPACK_INSTRUMENT
+	// per-type totals; times, bytes, elements and allocations include nested objects
+	struct Stats {
+		const char* type;
+		uint64_t packCalls;
+		uint64_t unpackCalls;
+		uint64_t bytesPacked;
+		uint64_t bytesUnpacked;
+		uint64_t elements;
+		uint64_t allocations;
+		uint64_t nanoseconds;
+	};
+
+	// Counters live in thread-local slots written only by their own thread with relaxed
+	// atomics, so the hot path never locks. snapshot() sums every live thread and the
+	// totals of threads that have exited.
+	class Instrument {
+	public:
+		enum Counter {
+			PackCalls, UnpackCalls, BytesPacked, BytesUnpacked, Elements, Allocations, Nanoseconds, CounterCount
+		};
+		enum { MaxTypes = CA_MSGPACK_INSTRUMENT_MAX_TYPES };
+	private:
+		struct Thread;
+		struct Registry {
+			std::mutex mutex;
+			std::vector<const char*> types;
+			std::vector<Thread*> threads;
+			uint64_t retired[MaxTypes][CounterCount];
+			uint64_t (*allocationCounter)();
+		};
+		struct Thread {
+			std::atomic<uint64_t> counters[MaxTypes][CounterCount];
+			uint64_t elements;
+			Thread() : elements(0) {
+				for (auto& slot : counters) {
+					for (auto& counter : slot) {
+						counter.store(0, std::memory_order_relaxed);
+					}
+				}
+				Registry& r = registry();
+				std::lock_guard<std::mutex> lock(r.mutex);
+				r.threads.push_back(this);
+			}
+			~Thread() {
+				Registry& r = registry();
+				std::lock_guard<std::mutex> lock(r.mutex);
+				for (int i = 0; i < MaxTypes; i++) {
+					for (int j = 0; j < CounterCount; j++) {
+						r.retired[i][j] += counters[i][j].load(std::memory_order_relaxed);
+					}
+				}
+				r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+			}
+		};
+		static Registry& registry() {
+			static Registry r = {};
+			return r;
+		}
+		// readable name of a type_info; GCC and Clang only give the mangled form
+		static std::string typeName(const char* name) {
+#ifdef CA_MSGPACK_DEMANGLE
+			int status = 0;
+			if (char* demangled = abi::__cxa_demangle(name, NULL, NULL, &status)) {
+				std::string readable(demangled);
+				free(demangled);
+				return readable;
+			}
+#endif
+			return name;
+		}
+		static uint32_t registerType(const char* name) {
+			Registry& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			r.types.push_back(name);
+			// types beyond MaxTypes share the last slot
+			return (uint32_t)std::min(r.types.size() - 1, (size_t)MaxTypes - 1);
+		}
+	public:
+		static Thread& thread() {
+			static thread_local Thread t;
+			return t;
+		}
+		template <class T>
+		static uint32_t typeId() {
+			static const std::string name = typeName(typeid(T).name());
+			static const uint32_t id = registerType(name.c_str());
+			return id;
+		}
+		static void add(uint32_t type, Counter counter, uint64_t value) {
+			std::atomic<uint64_t>& c = thread().counters[type][counter];
+			c.store(c.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+		static void visit(uint64_t count) {
+			thread().elements += count;
+		}
+		static uint64_t elements() {
+			return thread().elements;
+		}
+		// counter returns the calling thread's heap allocation count (e.g. from a hooked operator new)
+		static void setAllocationCounter(uint64_t (*counter)()) {
+			registry().allocationCounter = counter;
+		}
+		static uint64_t allocations() {
+			uint64_t (*counter)() = registry().allocationCounter;
+			return counter != NULL ? counter() : 0;
+		}
+		static std::vector<Stats> snapshot() {
+			Registry& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			std::vector<Stats> stats;
+			for (size_t i = 0; i < r.types.size() && i < MaxTypes; i++) {
+				uint64_t values[CounterCount];
+				for (int j = 0; j < CounterCount; j++) {
+					values[j] = r.retired[i][j];
+					for (Thread* t : r.threads) {
+						values[j] += t->counters[i][j].load(std::memory_order_relaxed);
+					}
+				}
+				Stats s = { i == MaxTypes - 1 && r.types.size() > MaxTypes ? "(other)" : r.types[i],
+					values[PackCalls], values[UnpackCalls], values[BytesPacked], values[BytesUnpacked],
+					values[Elements], values[Allocations], values[Nanoseconds] };
+				stats.push_back(s);
+			}
+			return stats;
+		}
+	};
+#else
+	class Instrument {
+	public:
+		static void visit(uint64_t) {
+		}
+	};
+#endif
+
+	// writes MessagePack bytes into a std::string, a caller-supplied buffer or a std::streambuf
+	class Writer {
+	private:
+		std::string* _string;
+		std::streambuf* _sb;
+		char* _begin;
+		char* _cur;
+		char* _end;
+		size_t _start;
+		size_t _flushed;
+		bool _positional;
+		char _chunk[512];
+		Writer(const Writer&);
+		Writer& operator=(const Writer&);
+		void grow(size_t size) {
+			size_t used = _cur - _begin;
+			if (_string != NULL) {
+				// grow with what this writer has produced, not with whatever the string already held
+				size_t capacity = _string->size() + std::max(size, std::max(used, (size_t)64));
+				_string->resize(capacity);
+				_begin = &(*_string)[0] + _flushed;
+				_cur = _begin + used;
+				_end = &(*_string)[0] + capacity;
+			} else if (_sb != NULL) {
+				flush();
+			}
+			if ((size_t)(_end - _cur) < size) {
+				throw ca_msgpack::MsgPackError();
+			}
+		}
+		void reserve(size_t size) {
+			if ((size_t)(_end - _cur) < size) {
+				grow(size);
+			}
+		}
+		template <class T>
+		void put(uint8_t type, T value) {
+			reserve(1 + sizeof(T));
+			*_cur++ = (char)type;
+			value = EndianUtil::change(value);
+			memcpy(_cur, &value, sizeof(T));
+			_cur += sizeof(T);
+		}
+		void putHeader(uint8_t fix, uint8_t fixMax, uint8_t type16, uint8_t type32, uint32_t length) {
+			if (length <= fixMax) {
+				reserve(1);
+				*_cur++ = (char)(fix | length);
+			} else if (length <= 0xffff) {
+				put(type16, (uint16_t)length);
+			} else {
+				put(type32, length);
+			}
+		}
+	public:
+		explicit Writer(std::string& buffer) : _string(&buffer), _sb(NULL), _start(buffer.size()), _flushed(buffer.size()), _positional(false) {
+			_begin = _cur = _end = &(*_string)[0] + _flushed;
+		}
+		Writer(char* buffer, size_t size) : _string(NULL), _sb(NULL), _begin(buffer), _cur(buffer), _end(buffer + size), _start(0), _flushed(0), _positional(false) {
+		}
+		explicit Writer(std::streambuf* sb) : _string(NULL), _sb(sb), _begin(_chunk), _cur(_chunk), _end(_chunk + sizeof(_chunk)), _start(0), _flushed(0), _positional(false) {
+		}
+		// flushes even while unwinding, so a caller that keeps the buffer must cut a partial object off itself
+		~Writer() {
+			try { flush(); } catch (...) {}
+		}
+		// positional: CA_MSGPACK objects are written as arrays in declaration order instead of maps
+		void setPositional(bool positional) {
+			_positional = positional;
+		}
+		bool positional() const {
+			return _positional;
+		}
+		// number of bytes written so far
+		size_t size() const {
+			return _flushed - _start + (_cur - _begin);
+		}
+		void flush() {
+			if (_string != NULL) {
+				_flushed += _cur - _begin;
+				_string->resize(_flushed);
+				_begin = _cur = _end = &(*_string)[0] + _flushed;
+			} else if (_sb != NULL) {
+				std::streamsize length = _cur - _begin;
+				_cur = _begin;
+				_flushed += length;
+				if (_sb->sputn(_begin, length) != length) {
+					throw ca_msgpack::MsgPackError();
+				}
+			}
+		}
+		void writeRaw(const char* data, size_t length) {
+			if (_sb != NULL && length > sizeof(_chunk)) {
+				flush();
+				if (_sb->sputn(data, length) != (std::streamsize)length) {
+					throw ca_msgpack::MsgPackError();
+				}
+				_flushed += length;
+				return;
+			}
+			reserve(length);
+			memcpy(_cur, data, length);
+			_cur += length;
+		}
+		void writeNil() {
+			reserve(1);
+			*_cur++ = (char)0xc0;
+		}
+		void writeBool(bool value) {
+			reserve(1);
+			*_cur++ = (char)(value ? 0xc3 : 0xc2);
+		}
+		// smallest encoding for the value
+		void writeInt(int64_t value) {
+			if (value >= 0) {
+				writeUInt((uint64_t)value);
+			} else if (value >= -32) {
+				reserve(1);
+				*_cur++ = (char)value;
+			} else if (value >= INT8_MIN) {
+				put(0xd0, (int8_t)value);
+			} else if (value >= INT16_MIN) {
+				put(0xd1, (int16_t)value);
+			} else if (value >= INT32_MIN) {
+				put(0xd2, (int32_t)value);
+			} else {
+				put(0xd3, value);
+			}
+		}
+		void writeUInt(uint64_t value) {
+			if (value <= 0x7f) {
+				reserve(1);
+				*_cur++ = (char)value;
+			} else if (value <= UINT8_MAX) {
+				put(0xcc, (uint8_t)value);
+			} else if (value <= UINT16_MAX) {
+				put(0xcd, (uint16_t)value);
+			} else if (value <= UINT32_MAX) {
+				put(0xce, (uint32_t)value);
+			} else {
+				put(0xcf, value);
+			}
+		}
+		// fixed width encoding (the format MapSerializer has always produced)
+		void writeInt64(int64_t value) {
+			put(0xd3, value);
+		}
+		void writeUInt64(uint64_t value) {
+			put(0xcf, value);
+		}
+		void writeFloat(float value) {
+			put(0xca, value);
+		}
+		// run of numbers in the NumberFormat encoding, reserving space once per block
+		template <class T>
+		void writeNumbers(const T* values, size_t count) {
+			typedef typename NumberFormat<T>::Wire Wire;
+			const size_t size = 1 + sizeof(Wire);
+			while (count != 0) {
+				size_t block = (size_t)(_end - _cur) / size;
+				if (block == 0) {
+					reserve(_sb != NULL ? size : size * count);
+					continue;
+				}
+				if (block > count) {
+					block = count;
+				}
+				char* p = _cur;
+				for (size_t i = 0; i < block; i++) {
+					Wire value = EndianUtil::change((Wire)values[i]);
+					p[0] = (char)NumberFormat<T>::type;
+					memcpy(p + 1, &value, sizeof(Wire));
+					p += size;
+				}
+				_cur = p;
+				values += block;
+				count -= block;
+			}
+		}
+		void writeDouble(double value) {
+			put(0xcb, value);
+		}
+		void writeString(const char* data, size_t length) {
+			if (length <= 31) {
+				reserve(1 + length);
+				*_cur++ = (char)(0xa0 | length);
+			} else if (length <= UINT8_MAX) {
+				put(0xd9, (uint8_t)length);
+			} else if (length <= UINT16_MAX) {
+				put(0xda, (uint16_t)length);
+			} else {
+				put(0xdb, (uint32_t)length);
+			}
+			writeRaw(data, length);
+		}
+		void writeString(const std::string& value) {
+			writeString(value.data(), value.size());
+		}
+		void writeBin(const char* data, size_t length) {
+			if (length <= UINT8_MAX) {
+				put(0xc4, (uint8_t)length);
+			} else if (length <= UINT16_MAX) {
+				put(0xc5, (uint16_t)length);
+			} else {
+				put(0xc6, (uint32_t)length);
+			}
+			writeRaw(data, length);
+		}
+		// timestamp extension (type -1) in its smallest form; nanoseconds < 1000000000
+		void writeTimestamp(int64_t seconds, uint32_t nanoseconds) {
+			if (seconds >= 0 && ((uint64_t)seconds >> 34) == 0) {
+				reserve(1);
+				if (nanoseconds == 0 && (uint64_t)seconds <= UINT32_MAX) {
+					*_cur++ = (char)0xd6;
+					put((uint8_t)0xff, (uint32_t)seconds);
+				} else {
+					*_cur++ = (char)0xd7;
+					put((uint8_t)0xff, ((uint64_t)nanoseconds << 34) | (uint64_t)seconds);
+				}
+			} else {
+				reserve(2);
+				*_cur++ = (char)0xc7;
+				*_cur++ = (char)12;
+				put((uint8_t)0xff, nanoseconds);
+				reserve(sizeof(seconds));
+				int64_t value = EndianUtil::change(seconds);
+				memcpy(_cur, &value, sizeof(value));
+				_cur += sizeof(value);
+			}
+		}
+		void writeArrayHeader(uint32_t length) {
+			putHeader(0x90, 0x0f, 0xdc, 0xdd, length);
+		}
+		void writeMapHeader(uint32_t length) {
+			putHeader(0x80, 0x0f, 0xde, 0xdf, length);
+		}
+	};
+
+	// field names of a CA_MSGPACK type, split once from its stringized argument list.
+	// find() resolves a wire key through a perfect hash built over the names at that point.
+	class Names {
+	public:
+		struct Name {
+			const char* data;
+			uint32_t length;
+		};
+	private:
+		std::vector<Name> _names;
+		std::vector<int16_t> _slots;
+		uint32_t _mask;
+		uint32_t _seed;
+		bool _full;
+		// length plus first and last byte, or every byte once those collide
+		uint32_t hash(const char* key, size_t length) const {
+			uint32_t h = (_seed ^ (uint32_t)length) * 16777619u;
+			if (_full) {
+				for (size_t i = 0; i < length; i++) {
+					h = (h ^ (uint8_t)key[i]) * 16777619u;
+				}
+			} else if (length > 0) {
+				h = (h ^ (uint8_t)key[0]) * 16777619u;
+				h = (h ^ (uint8_t)key[length - 1]) * 16777619u;
+			}
+			return h ^ (h >> 16);
+		}
+		bool place() {
+			std::fill(_slots.begin(), _slots.end(), (int16_t)-1);
+			for (size_t i = 0; i < _names.size(); i++) {
+				int16_t& slot = _slots[hash(_names[i].data, _names[i].length) & _mask];
+				if (slot >= 0) {
+					return false;
+				}
+				slot = (int16_t)i;
+			}
+			return true;
+		}
+		void build() {
+			for (size_t i = 0; i < _names.size(); i++) {
+				for (size_t j = 0; j < i; j++) {
+					if (equals(j, _names[i].data, _names[i].length)) { throw ca_msgpack::MsgPackError(); }
+				}
+			}
+			size_t base = 4;
+			while (base < _names.size() * 2) {
+				base <<= 1;
+			}
+			for (int full = 0; full < 2; full++) {
+				_full = full != 0;
+				for (size_t size = base; size <= base * 16; size <<= 1) {
+					_slots.resize(size);
+					_mask = (uint32_t)size - 1;
+					for (_seed = 0; _seed < 256; _seed++) {
+						if (place()) {
+							return;
+						}
+					}
+				}
+			}
+			throw ca_msgpack::MsgPackError();
+		}
+	public:
+		explicit Names(const char* list) : _mask(0), _seed(0), _full(false) {
+			const char* p = list;
+			while (*p != '\0') {
+				while (*p == ',' || isspace((unsigned char)*p)) {
+					p++;
+				}
+				const char* begin = p;
+				while (*p != '\0' && *p != ',' && !isspace((unsigned char)*p)) {
+					p++;
+				}
+				if (p != begin) {
+					Name name = { begin, (uint32_t)(p - begin) };
+					_names.push_back(name);
+				}
+			}
+			if (_names.size() > INT16_MAX) { throw ca_msgpack::MsgPackError(); }
+			build();
+		}
+		size_t size() const {
+			return _names.size();
+		}
+		const Name& operator[](size_t index) const {
+			return _names[index];
+		}
+		bool equals(size_t index, const char* key, size_t length) const {
+			return _names[index].length == length && memcmp(_names[index].data, key, length) == 0;
+		}
+		// index of the field called key, or -1
+		int find(const char* key, size_t length) const {
+			int index = _slots[hash(key, length) & _mask];
+			if (index >= 0 && equals(index, key, length)) {
+				return index;
+			}
+			return -1;
+		}
+	};
+
+	template <size_t... I>
+	struct Indices {};
+	template <size_t N, size_t... I>
+	struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+	template <size_t... I>
+	struct MakeIndices<0, I...> {
+		typedef Indices<I...> type;
+	};
+
+	// integer durations finer than a second, whose range in seconds is narrower than the timestamp's
+	template <class Duration>
+	struct SubSecond : std::integral_constant<bool, std::ratio_less<typename Duration::period, std::ratio<1> >::value
+		&& !std::chrono::treat_as_floating_point<typename Duration::rep>::value> {};
+
 	class MapSerializer {
 	private:
-		MsgPack::Serializer& _serializer;
-		void serializeValue(const std::string& value) {
-			std::unique_ptr<MsgPack::Element> _value(new MsgPack::String(value));
-			_serializer << _value;
+		Writer& _writer;
+		template <class Traits, class Alloc>
+		void serializeValue(const std::basic_string<char, Traits, Alloc>& value) {
+			_writer.writeString(value.data(), value.size());
+		}
+#ifdef CA_MSGPACK_CXX17
+		void serializeValue(std::string_view value) {
+			_writer.writeString(value.data(), value.size());
+		}
+#endif
+		void serializeValue(const BytesView& value) {
+			_writer.writeBin(value.data(), value.size());
+		}
+		template <class Alloc>
+		void serializeValue(const std::vector<uint8_t, Alloc>& value) {
+			_writer.writeBin((const char*)value.data(), value.size());
+		}
+		void serializeValue(int8_t value) {
+			_writer.writeInt(value);
+		}
+		void serializeValue(uint8_t value) {
+			_writer.writeUInt(value);
+		}
+		void serializeValue(int16_t value) {
+			_writer.writeInt(value);
+		}
+		void serializeValue(uint16_t value) {
+			_writer.writeUInt(value);
 		}
 		void serializeValue(int32_t value) {
-			std::unique_ptr<MsgPack::Element> _value(new MsgPack::Number(EndianUtil::change((int64_t)value)));
-			_serializer << _value;
+			_writer.writeInt64(value);
 		}
 		void serializeValue(uint32_t value) {
-			std::unique_ptr<MsgPack::Element> _value(new MsgPack::Number(EndianUtil::change((uint64_t)value)));
-			_serializer << _value;
+			_writer.writeUInt64(value);
 		}
 		void serializeValue(int64_t value) {
-			std::unique_ptr<MsgPack::Element> _value(new MsgPack::Number(EndianUtil::change(value)));
-			_serializer << _value;
+			_writer.writeInt64(value);
 		}
 		void serializeValue(uint64_t value) {
-			std::unique_ptr<MsgPack::Element> _value(new MsgPack::Number(EndianUtil::change(value)));
-			_serializer << _value;
+			_writer.writeUInt64(value);
 		}
 		void serializeValue(float value) {
-			std::unique_ptr<MsgPack::Element> _value(new MsgPack::Number(EndianUtil::change(value)));
-			_serializer << _value;
+			_writer.writeFloat(value);
 		}
 		void serializeValue(double value) {
-			std::unique_ptr<MsgPack::Element> _value(new MsgPack::Number(EndianUtil::change(value)));
-			_serializer << _value;
+			_writer.writeDouble(value);
 		}
 		void serializeValue(bool value) {
-			std::unique_ptr<MsgPack::Element> _value(new MsgPack::Primitive(value));
-			_serializer << _value;
+			_writer.writeBool(value);
 		}
-		template <class T>
-		void serializeValue(const std::vector<T>& value) {
-			std::unique_ptr<MsgPack::Element> _header(new MsgPack::ArrayHeader((uint32_t)value.size()));
-			_serializer << _header;
-			for (auto ite = value.begin(); ite != value.end(); ite++) {
-				serializeValue((T)*ite);
+		template <class Duration>
+		void serializeTimestamp(Duration since, std::true_type) {
+			// the sub-second part, kept in Duration units so that the seconds are never converted back
+			Duration rem = since % std::chrono::seconds(1);
+			std::chrono::seconds seconds = std::chrono::duration_cast<std::chrono::seconds>(since - rem);
+			// round towards the past so that the nanoseconds are never negative
+			if (rem < Duration::zero()) {
+				rem += std::chrono::seconds(1);
+				seconds -= std::chrono::seconds(1);
+			}
+			_writer.writeTimestamp(seconds.count(), (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(rem).count());
+		}
+		template <class Duration>
+		void serializeTimestamp(Duration since, std::false_type) {
+			// coarser or floating point durations can go beyond the int64 seconds of a timestamp;
+			// a floating point bound itself may round up past them
+			const Duration most = std::chrono::duration_cast<Duration>(std::chrono::seconds::max());
+			const Duration least = std::chrono::duration_cast<Duration>(std::chrono::seconds::min());
+			const bool floating = std::chrono::treat_as_floating_point<typename Duration::rep>::value;
+			if (since > most || since < least || (floating && (since == most || since == least))) {
+				throw ca_msgpack::MsgPackError();
+			}
+			std::chrono::seconds seconds = std::chrono::duration_cast<std::chrono::seconds>(since);
+			if (seconds > since) {
+				seconds -= std::chrono::seconds(1);
 			}
+			_writer.writeTimestamp(seconds.count(), (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(since - seconds).count());
 		}
+		template <class Duration>
+		void serializeValue(const std::chrono::time_point<std::chrono::system_clock, Duration>& value) {
+			serializeTimestamp(value.time_since_epoch(), SubSecond<Duration>());
+		}
+#ifdef CA_MSGPACK_CXX17
 		template <class T>
-		void serializeValue(const std::map<std::string, T>& value) {
-			std::unique_ptr<MsgPack::Element> _header(new MsgPack::MapHeader((uint32_t)value.size()));
-			_serializer << _header;
+		void serializeValue(const std::optional<T>& value) {
+			if (value) {
+				serializeValue(*value);
+			} else {
+				_writer.writeNil();
+			}
+		}
+#endif
+		template <class V>
+		void serializeElements(const V& value, std::true_type) {
+			_writer.writeNumbers(value.data(), value.size());
+		}
+		template <class V>
+		void serializeElements(const V& value, std::false_type) {
+			for (const auto& element : value) {
+				serializeValue(static_cast<const typename V::value_type&>(element));
+			}
+		}
+		template <class T, class Alloc>
+		void serializeValue(const std::vector<T, Alloc>& value) {
+			Instrument::visit(value.size());
+			_writer.writeArrayHeader((uint32_t)value.size());
+			serializeElements(value, std::integral_constant<bool, NumberFormat<T>::enabled>());
+		}
+		template <class T, size_t N>
+		void serializeValue(const std::array<T, N>& value) {
+			Instrument::visit(N);
+			_writer.writeArrayHeader((uint32_t)N);
+			serializeElements(value, std::integral_constant<bool, NumberFormat<T>::enabled>());
+		}
+		template <class M>
+		void serializeEntries(const M& value) {
+			Instrument::visit(value.size());
+			_writer.writeMapHeader((uint32_t)value.size());
 			for (auto ite = value.begin(); ite != value.end(); ite++) {
 				serializeValue((*ite).first);
 				serializeValue((*ite).second);
 			}
 		}
+		template <class Key, class T, class Compare, class Alloc>
+		void serializeValue(const std::map<Key, T, Compare, Alloc>& value) {
+			serializeEntries(value);
+		}
+		template <class Key, class T, class Hash, class Equal, class Alloc>
+		void serializeValue(const std::unordered_map<Key, T, Hash, Equal, Alloc>& value) {
+			serializeEntries(value);
+		}
 		template <class T>
 		void serializeValue(const T& value) {
-			value.pack(_serializer);
+			value.pack(_writer);
 		}
+		struct FieldWriter {
+			MapSerializer& serializer;
+			const Names& names;
+			template <class... Args>
+			void operator()(const Args&... args) {
+				size_t i = 0;
+				int expand[] = { 0, (serializer.serialize(names[i].data, names[i].length, args), i++, 0)... };
+				(void)expand;
+			}
+		};
+		struct PositionalWriter {
+			MapSerializer& serializer;
+			template <class... Args>
+			void operator()(const Args&... args) {
+				int expand[] = { 0, (serializer.serializeValue(args), 0)... };
+				(void)expand;
+			}
+		};
 	public:
-		MapSerializer(MsgPack::Serializer& serializer, int count) : _serializer(serializer) {
-			std::unique_ptr<MsgPack::Element> _header(new MsgPack::MapHeader(count));
-			_serializer << _header;
+		MapSerializer(Writer& writer) : _writer(writer) {
+		}
+		// writes obj as a map keyed by its CA_MSGPACK field names
+		template <class T>
+		void serializeObject(const T& obj) {
+			const Names& names = T::msgpackNames();
+			if (_writer.positional()) {
+				Instrument::visit(names.size());
+				_writer.writeArrayHeader((uint32_t)names.size());
+				obj.msgpackFields(PositionalWriter{ *this });
+			} else {
+				_writer.writeMapHeader((uint32_t)names.size());
+				obj.msgpackFields(FieldWriter{ *this, names });
+			}
 		}
 		template<class T>
-		void serialize(const char* key, T value) {
-			std::unique_ptr<MsgPack::Element> _key(new MsgPack::String(key));
-			_serializer << _key;
+		void serialize(const char* key, size_t length, const T& value) {
+			Instrument::visit(1);
+			_writer.writeString(key, length);
 			serializeValue(value);
 		}
 	};
 
-	class MapDeserializer {
-	private:
-		typedef void (MapDeserializer::*INIT_MEMBER_FUNC)(void*);
-		typedef void (MapDeserializer::*ADD_MEMBER_FUNC)(const char*, const char*, void*);
-		enum class Type {
-			Integer32, Integer32U, Integer64, Integer64U,
-			Float, Double, Boolean, String, Object, Map, Array
-		};
-		struct Member {
-			Type type;
-			void* obj;
-			INIT_MEMBER_FUNC initFunc;
-			ADD_MEMBER_FUNC addFunc;
-			Member() {}
-			Member(Type type, void* obj, INIT_MEMBER_FUNC initFunc = NULL, ADD_MEMBER_FUNC addFunc = NULL)
-				: type(type), obj(obj), initFunc(initFunc), addFunc(addFunc) {}
-		};
-		MsgPack::Deserializer& _deserializer;
-		std::map<std::string, Member> _members;
-		bool isString(uint32_t type) {
-			return (type & 0xf0) == MsgPack::Type::FIXSTR || type == MsgPack::Type::STR_8
-				|| type == MsgPack::Type::STR_16 || type == MsgPack::Type::STR_32;
-		}
-		bool isMap(uint32_t type) {
-			return (type & 0xf0) == MsgPack::Type::FIXMAP
-				|| type == MsgPack::Type::MAP_16 || type == MsgPack::Type::MAP_32;
-		}
-		bool isArray(uint32_t type) {
-			return (type & 0xf0) == MsgPack::Type::FIXARRAY
-				|| type == MsgPack::Type::ARRAY_16 || type == MsgPack::Type::ARRAY_32;
-		}
-		void parseObject(Element& header, const char* dir = "") {
-			uint32_t len = static_cast<MsgPack::Header*>(header.get())->getLength();
-			for (uint32_t i = 0; i < len; i++) {
-				Element key;
-				_deserializer.deserialize(key, false);
-				if (!key) { break; }
-				if (!isString(key->getType())) {
-					throw ca_msgpack::MsgPackError();
-				}
-				std::ostringstream keyStr;
-				keyStr << dir << (*key);
-				value(keyStr.str().c_str());
-			}
+	// re-encodes natively packed bytes through netLink for the MsgPack::Serializer overloads
+	template <class T>
+	void pack(const T& obj, MsgPack::Serializer& serializer) {
+		std::string packed;
+		{
+			Writer writer(packed);
+			obj.pack(writer);
 		}
-		void parseArray(Element& header, const char* dir, Member& member) {
-			uint32_t len = static_cast<MsgPack::Header*>(header.get())->getLength();
-			(this->*member.initFunc)(member.obj);
-			for (uint32_t i = 0; i < len; i++) {
-				std::ostringstream key;
-				key << dir << i;
-				(this->*member.addFunc)(key.str().c_str(), NULL, member.obj);
-				value(key.str().c_str());
+		std::stringbuf sb(packed);
+		MsgPack::Deserializer deserializer(&sb);
+		Element element;
+		deserializer.deserialize(element, true);
+		if (!element) { throw ca_msgpack::MsgPackError(); }
+		serializer << element;
+	}
+
+	// layout of a MessagePack object as told by its type byte
+	struct Header {
+		enum Kind { Payload, Elements, Pairs, Invalid };
+		Kind kind;
+		// size of the big-endian length that follows the type byte
+		size_t lengthBytes;
+		// length of fix types
+		uint64_t length;
+		// payload bytes beyond length: number bodies, the ext type byte
+		uint64_t extra;
+		bool string;
+		explicit Header(uint8_t type) : kind(Payload), lengthBytes(0), length(0), extra(0), string(false) {
+			if (type <= 0x7f || type >= 0xe0) {
+			} else if (type <= 0x8f) {
+				length = type & 0x0f;
+				kind = Pairs;
+			} else if (type <= 0x9f) {
+				length = type & 0x0f;
+				kind = Elements;
+			} else if (type <= 0xbf) {
+				length = type & 0x1f;
+				string = true;
+			} else {
+				switch (type) {
+					case 0xc0: case 0xc2: case 0xc3: break;
+					case 0xc4: lengthBytes = 1; break;
+					case 0xc5: lengthBytes = 2; break;
+					case 0xc6: lengthBytes = 4; break;
+					case 0xd9: lengthBytes = 1; string = true; break;
+					case 0xda: lengthBytes = 2; string = true; break;
+					case 0xdb: lengthBytes = 4; string = true; break;
+					case 0xc7: lengthBytes = 1; extra = 1; break;
+					case 0xc8: lengthBytes = 2; extra = 1; break;
+					case 0xc9: lengthBytes = 4; extra = 1; break;
+					case 0xca: case 0xce: case 0xd2: extra = 4; break;
+					case 0xcb: case 0xcf: case 0xd3: extra = 8; break;
+					case 0xcc: case 0xd0: extra = 1; break;
+					case 0xcd: case 0xd1: extra = 2; break;
+					case 0xd4: extra = 2; break;
+					case 0xd5: extra = 3; break;
+					case 0xd6: extra = 5; break;
+					case 0xd7: extra = 9; break;
+					case 0xd8: extra = 17; break;
+					case 0xdc: lengthBytes = 2; kind = Elements; break;
+					case 0xdd: lengthBytes = 4; kind = Elements; break;
+					case 0xde: lengthBytes = 2; kind = Pairs; break;
+					case 0xdf: lengthBytes = 4; kind = Pairs; break;
+					default: kind = Invalid; break;
+				}
 			}
 		}
-		void parseMap(Element& header, const char* dir, Member& member) {
-			uint32_t len = static_cast<MsgPack::Header*>(header.get())->getLength();
-			(this->*member.initFunc)(member.obj);
-			for (uint32_t i = 0; i < len; i++) {
-				Element key;
-				_deserializer.deserialize(key, false);
-				if (!key) { break; }
-				if (!isString(key->getType())) {
-					throw ca_msgpack::MsgPackError();
-				}
-				std::ostringstream keyStr;
-				keyStr << dir << (*key);
-				(this->*member.addFunc)(keyStr.str().c_str(), static_cast<MsgPack::String*>(key.get())->getStr().c_str(), member.obj);
-				value(keyStr.str().c_str());
+		// the length, given the lengthBytes that follow the type byte
+		uint64_t read(const uint8_t* p) const {
+			uint64_t value = length;
+			for (size_t i = 0; i < lengthBytes; i++) {
+				value = (value << 8) | p[i];
 			}
+			return value;
 		}
-		template <class T>
-		void parseNumber(Element& element, Member& member) {
-			T& obj = *(T*)member.obj;
-			switch(element->getType()) {
-#define __CAMP_PARSE_NUMBER__(type) (T)EndianUtil::change(static_cast<MsgPack::Number*>(element.get())->getValue<type>())
-				case MsgPack::Type::FIXINT:
-				case MsgPack::Type::INT_8: obj = __CAMP_PARSE_NUMBER__(int8_t); break;
-				case MsgPack::Type::INT_16: obj = __CAMP_PARSE_NUMBER__(int16_t); break;
-				case MsgPack::Type::INT_32: obj = __CAMP_PARSE_NUMBER__(int32_t); break;
-				case MsgPack::Type::INT_64: obj = __CAMP_PARSE_NUMBER__(int64_t); break;
-				case MsgPack::Type::FIXUINT:
-				case MsgPack::Type::UINT_8: obj = __CAMP_PARSE_NUMBER__(uint8_t); break;
-				case MsgPack::Type::UINT_16: obj = __CAMP_PARSE_NUMBER__(uint16_t); break;
-				case MsgPack::Type::UINT_32: obj = __CAMP_PARSE_NUMBER__(uint32_t); break;
-				case MsgPack::Type::UINT_64: obj = __CAMP_PARSE_NUMBER__(uint64_t); break;
-				case MsgPack::Type::FLOAT_32: obj = __CAMP_PARSE_NUMBER__(float); break;
-				case MsgPack::Type::FLOAT_64: obj = __CAMP_PARSE_NUMBER__(double); break;
-				default: throw ca_msgpack::MsgPackError();
-#undef __CAMP_PARSE_NUMBER__
-			}
-		}
-		void parseValue(Element& element, Member& member) {
-			if (member.type == Type::Integer32) {
-				parseNumber<int32_t>(element, member);
-			} else if (member.type == Type::Integer32U) {
-				parseNumber<uint32_t>(element, member);
-			} else if (member.type == Type::Integer64) {
-				parseNumber<int64_t>(element, member);
-			} else if (member.type == Type::Integer64U) {
-				parseNumber<uint64_t>(element, member);
-			} else if (member.type == Type::Float) {
-				parseNumber<float>(element, member);
-			} else if (member.type == Type::Double) {
-				parseNumber<double>(element, member);
-			} else if (member.type == Type::Boolean) {
-				bool& obj = *(bool*)member.obj;
-				obj = static_cast<MsgPack::Primitive*>(element.get())->getValue();
-			} else if (member.type == Type::String) {
-				std::string& obj = *(std::string*)member.obj;
-				obj = static_cast<MsgPack::String*>(element.get())->getStr();
-			}
-		}
-		void value(const char* key, void* obj = NULL) {
-			Element element;
-			_deserializer.deserialize(element, false);
-			if (!element) { throw ca_msgpack::MsgPackError(); }
-			auto ite = _members.find(key);
-			if (ite != _members.end()) {
-				Member& member = ite->second;
-				if (member.type == Type::Object) {
-					std::ostringstream dir;
-					dir << key << '/';
-					parseObject(element, dir.str().c_str());
-				} else if (member.type == Type::Array || member.type == Type::Map) {
-					std::ostringstream dir;
-					dir << key << '/';
-					if (member.type == Type::Array) {
-						parseArray(element, dir.str().c_str(), member);
-					} else {
-						parseMap(element, dir.str().c_str(), member);
-					}
-				} else {
-					parseValue(element, member);
-				}
-			} else {
+	};
+
+	// cursor over a contiguous MessagePack buffer; strings are returned in place
+	class Reader {
+	private:
+		const char* _cur;
+		const char* _end;
+		bool _borrowable;
+		const char* take(size_t size) {
+			if ((size_t)(_end - _cur) < size) {
 				throw ca_msgpack::MsgPackError();
 			}
+			const char* p = _cur;
+			_cur += size;
+			return p;
 		}
 		template <class T>
-		void initArray(void* p) {
-			std::vector<T>& array = *(std::vector<T>*)p;
-			array.clear();
+		T load() {
+			T value;
+			memcpy(&value, take(sizeof(T)), sizeof(T));
+			return EndianUtil::change(value);
 		}
-		template <class T>
-		void addArray(const char* key, const char* shortKey, void* p) {
-			std::vector<T>& array = *(std::vector<T>*)p;
-			size_t index = array.size();
-			array.push_back(std::move(T()));
-			addMember(key, &array[index]);
+		uint8_t next() {
+			return (uint8_t)*take(1);
 		}
-		template <class T>
-		void initMap(void* p) {
-			std::map<std::string, T>& map = *(std::map<std::string, T>*)p;
-			map.clear();
+		uint32_t readHeader(uint8_t fix, uint8_t type16, uint8_t type32) {
+			uint8_t type = next();
+			if ((type & 0xf0) == fix) {
+				return type & 0x0f;
+			} else if (type == type16) {
+				return load<uint16_t>();
+			} else if (type == type32) {
+				return load<uint32_t>();
+			}
+			throw ca_msgpack::MsgPackError();
+		}
+		template <class S, class T>
+		size_t readRun(T* out, size_t count) {
+			const size_t size = 1 + sizeof(S);
+			const char* p = _cur;
+			const char type = *p;
+			size_t limit = std::min(count, (size_t)(_end - p) / size);
+			size_t n = 0;
+			while (n < limit && p[0] == type) {
+				S value;
+				memcpy(&value, p + 1, sizeof(S));
+				out[n++] = (T)EndianUtil::change(value);
+				p += size;
+			}
+			_cur = p;
+			return n;
 		}
 		template <class T>
-		void addMap(const char* key, const char* shortKey, void* p) {
-			std::map<std::string, T>& map = *(std::map<std::string, T>*)p;
-			map[shortKey] = std::move(T());
-			addMember(key, &map[shortKey]);
+		size_t readFixRun(T* out, size_t count) {
+			const char* p = _cur;
+			size_t limit = std::min(count, (size_t)(_end - p));
+			size_t n = 0;
+			while (n < limit && (uint8_t)p[n] <= 0x7f) {
+				out[n] = (T)(uint8_t)p[n];
+				n++;
+			}
+			_cur = p + n;
+			return n;
 		}
 	public:
-		MapDeserializer(MsgPack::Deserializer& deserializer) : _deserializer(deserializer) {
-		}
-		void addMember(const char* key, int32_t* obj) {
-			_members[key] = Member(Type::Integer32, obj);
-		}
-		void addMember(const char* key, uint32_t* obj) {
-			_members[key] = Member(Type::Integer32U, obj);
+		// borrowable: the buffer outlives the decoded object, so views may point into it
+		Reader(const char* data, size_t length, bool borrowable = true) : _cur(data), _end(data + length), _borrowable(borrowable) {
 		}
-		void addMember(const char* key, int64_t* obj) {
-			_members[key] = Member(Type::Integer64, obj);
+		bool borrowable() const {
+			return _borrowable;
 		}
-		void addMember(const char* key, uint64_t* obj) {
-			_members[key] = Member(Type::Integer64U, obj);
+		const char* position() const {
+			return _cur;
 		}
-		void addMember(const char* key, float* obj) {
-			_members[key] = Member(Type::Float, obj);
+		size_t remaining() const {
+			return _end - _cur;
 		}
-		void addMember(const char* key, double* obj) {
-			_members[key] = Member(Type::Double, obj);
+		uint8_t peek() const {
+			if (_cur == _end) {
+				throw ca_msgpack::MsgPackError();
+			}
+			return (uint8_t)*_cur;
 		}
-		void addMember(const char* key, bool* obj) {
-			_members[key] = Member(Type::Boolean, obj);
+		uint32_t readMapHeader() {
+			return readHeader(0x80, 0xde, 0xdf);
 		}
-		void addMember(const char* key, std::string* obj) {
-			_members[key] = Member(Type::String, obj);
+		uint32_t readArrayHeader() {
+			return readHeader(0x90, 0xdc, 0xdd);
 		}
-		template <class T>
-		void addMember(const char* key, std::vector<T>* obj) {
-			_members[key] = Member(Type::Array, obj, &MapDeserializer::initArray<T>, &MapDeserializer::addArray<T>);
+		void readString(const char*& data, uint32_t& length) {
+			uint8_t type = next();
+			if ((type & 0xe0) == 0xa0) {
+				length = type & 0x1f;
+			} else if (type == 0xd9) {
+				length = load<uint8_t>();
+			} else if (type == 0xda) {
+				length = load<uint16_t>();
+			} else if (type == 0xdb) {
+				length = load<uint32_t>();
+			} else {
+				throw ca_msgpack::MsgPackError();
+			}
+			data = take(length);
 		}
-		template <class T>
-		void addMember(const char* key, std::map<std::string, T>* obj) {
-			_members[key] = Member(Type::Map, obj, &MapDeserializer::initMap<T>, &MapDeserializer::addMap<T>);
+		void readBin(const char*& data, uint32_t& length) {
+			uint8_t type = next();
+			if (type == 0xc4) {
+				length = load<uint8_t>();
+			} else if (type == 0xc5) {
+				length = load<uint16_t>();
+			} else if (type == 0xc6) {
+				length = load<uint32_t>();
+			} else {
+				throw ca_msgpack::MsgPackError();
+			}
+			data = take(length);
 		}
+		// decodes count numbers; runs sharing one encoding are converted in a tight loop
 		template <class T>
-		void addMember(const char* key, T* obj) {
-			std::ostringstream dir;
-			dir << key << '/';
-			obj->addMembers(*this, dir.str().c_str());
-			_members[key] = Member(Type::Object, obj);
-		}
-		void execute() {
-			Element header;
-			_deserializer.deserialize(header, false);
-			if (!header) { throw ca_msgpack::MsgPackError(); }
-			parseObject(header);
+		void readNumbers(T* out, size_t count) {
+			size_t i = 0;
+			while (i < count) {
+				size_t n = 0;
+				switch (peek()) {
+					case 0xca: n = readRun<float>(out + i, count - i); break;
+					case 0xcb: n = readRun<double>(out + i, count - i); break;
+					case 0xcc: n = readRun<uint8_t>(out + i, count - i); break;
+					case 0xcd: n = readRun<uint16_t>(out + i, count - i); break;
+					case 0xce: n = readRun<uint32_t>(out + i, count - i); break;
+					case 0xcf: n = readRun<uint64_t>(out + i, count - i); break;
+					case 0xd0: n = readRun<int8_t>(out + i, count - i); break;
+					case 0xd1: n = readRun<int16_t>(out + i, count - i); break;
+					case 0xd2: n = readRun<int32_t>(out + i, count - i); break;
+					case 0xd3: n = readRun<int64_t>(out + i, count - i); break;
+					default: n = readFixRun(out + i, count - i); break;
+				}
+				if (n == 0) {
+					// mixed or truncated input
+					out[i] = readNumber<T>();
+					n = 1;
+				}
+				i += n;
+			}
 		}
-		void execute(Element& header) {
-			parseObject(header);
+		void readNil() {
+			if (next() != 0xc0) {
+				throw ca_msgpack::MsgPackError();
+			}
+		}
+		void readTimestamp(int64_t& seconds, uint32_t& nanoseconds) {
+			uint8_t type = next();
+			if (type == 0xd6 && next() == 0xff) {
+				seconds = load<uint32_t>();
+				nanoseconds = 0;
+			} else if (type == 0xd7 && next() == 0xff) {
+				uint64_t value = load<uint64_t>();
+				nanoseconds = (uint32_t)(value >> 34);
+				seconds = (int64_t)(value & ((1ULL << 34) - 1));
+			} else if (type == 0xc7 && next() == 12 && next() == 0xff) {
+				nanoseconds = load<uint32_t>();
+				seconds = load<int64_t>();
+			} else {
+				throw ca_msgpack::MsgPackError();
+			}
+			if (nanoseconds >= 1000000000) {
+				throw ca_msgpack::MsgPackError();
+			}
+		}
+		bool readBool() {
+			uint8_t type = next();
+			if (type == 0xc2 || type == 0xc3) {
+				return type == 0xc3;
+			}
+			throw ca_msgpack::MsgPackError();
+		}
+		// steps over one object of any type without decoding it
+		void skip() {
+			uint64_t pending = 1;
+			while (pending != 0) {
+				pending--;
+				Header header(next());
+				if (header.kind == Header::Invalid) {
+					throw ca_msgpack::MsgPackError();
+				}
+				uint64_t length = header.read((const uint8_t*)take(header.lengthBytes));
+				if (header.kind == Header::Payload) {
+					if (length + header.extra > remaining()) {
+						throw ca_msgpack::MsgPackError();
+					}
+					take((size_t)(length + header.extra));
+				} else {
+					pending += header.kind == Header::Pairs ? length * 2 : length;
+				}
+				// every pending object takes at least one byte
+				if (pending > remaining()) {
+					throw ca_msgpack::MsgPackError();
+				}
+			}
+		}
+		template <class T>
+		T readNumber() {
+			uint8_t type = next();
+			if (type <= 0x7f) {
+				return (T)type;
+			} else if (type >= 0xe0) {
+				return (T)(int8_t)type;
+			}
+			switch (type) {
+				case 0xca: return (T)load<float>();
+				case 0xcb: return (T)load<double>();
+				case 0xcc: return (T)load<uint8_t>();
+				case 0xcd: return (T)load<uint16_t>();
+				case 0xce: return (T)load<uint32_t>();
+				case 0xcf: return (T)load<uint64_t>();
+				case 0xd0: return (T)load<int8_t>();
+				case 0xd1: return (T)load<int16_t>();
+				case 0xd2: return (T)load<int32_t>();
+				case 0xd3: return (T)load<int64_t>();
+				default: throw ca_msgpack::MsgPackError();
+			}
+		}
+	};
+
+#ifdef CA_MSGPACK_INSTRUMENT
+	// records one pack or unpack of T into the calling thread's counters
+	template <class T, bool Pack>
+	class Probe {
+	private:
+		uint32_t _type;
+		uint64_t _elements;
+		uint64_t _allocations;
+		std::chrono::steady_clock::time_point _begin;
+	public:
+		Probe() : _type(Instrument::typeId<typename std::decay<T>::type>()), _elements(Instrument::elements()),
+			_allocations(Instrument::allocations()), _begin(std::chrono::steady_clock::now()) {
+		}
+		void finish(uint64_t bytes) {
+			Instrument::add(_type, Pack ? Instrument::PackCalls : Instrument::UnpackCalls, 1);
+			Instrument::add(_type, Pack ? Instrument::BytesPacked : Instrument::BytesUnpacked, bytes);
+			Instrument::add(_type, Instrument::Elements, Instrument::elements() - _elements);
+			Instrument::add(_type, Instrument::Allocations, Instrument::allocations() - _allocations);
+			Instrument::add(_type, Instrument::Nanoseconds, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - _begin).count());
+		}
+	};
+	template <class T>
+	class PackProbe : private Probe<T, true> {
+	private:
+		const Writer& _writer;
+		size_t _size;
+	public:
+		PackProbe(const Writer& writer) : _writer(writer), _size(writer.size()) {
+		}
+		~PackProbe() {
+			this->finish(_writer.size() - _size);
+		}
+	};
+	template <class T>
+	class UnpackProbe : private Probe<T, false> {
+	private:
+		const Reader& _reader;
+		const char* _position;
+	public:
+		UnpackProbe(const Reader& reader) : _reader(reader), _position(reader.position()) {
+		}
+		~UnpackProbe() {
+			this->finish(_reader.position() - _position);
+		}
+	};
+#else
+	template <class T>
+	class PackProbe {
+	public:
+		PackProbe(const Writer&) {
+		}
+	};
+	template <class T>
+	class UnpackProbe {
+	public:
+		UnpackProbe(const Reader&) {
+		}
+	};
+#endif
+
+	// copies exactly one MessagePack object from sb into buffer
+	inline void readMessage(std::streambuf* sb, std::string& buffer) {
+		struct Input {
+			std::streambuf* sb;
+			std::string& buffer;
+			// grows the buffer a chunk at a time as bytes arrive, so a hostile length cannot allocate ahead of the data
+			const char* read(uint64_t size) {
+				size_t pos = buffer.size();
+				while (size != 0) {
+					size_t chunk = (size_t)std::min(size, (uint64_t)(64 << 10));
+					size_t at = buffer.size();
+					buffer.resize(at + chunk);
+					if (sb->sgetn(&buffer[at], chunk) != (std::streamsize)chunk) {
+						throw ca_msgpack::MsgPackError();
+					}
+					size -= chunk;
+				}
+				return &buffer[pos];
+			}
+		} input = { sb, buffer };
+		buffer.clear();
+		uint64_t remaining = 1;
+		while (remaining != 0) {
+			remaining--;
+			Header header((uint8_t)*input.read(1));
+			if (header.kind == Header::Invalid) {
+				throw ca_msgpack::MsgPackError();
+			}
+			uint64_t length = header.read((const uint8_t*)input.read(header.lengthBytes));
+			if (header.kind == Header::Payload) {
+				input.read(length + header.extra);
+			} else {
+				remaining += header.kind == Header::Pairs ? length * 2 : length;
+			}
+		}
+	}
+
+	// number of leading ASCII bytes, found a block at a time
+	inline size_t asciiPrefix(const uint8_t* p, size_t n) {
+		size_t i = 0;
+#if defined(CA_MSGPACK_SSE2)
+		while (i + 16 <= n && _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(p + i))) == 0) {
+			i += 16;
+		}
+#elif defined(CA_MSGPACK_NEON)
+		while (i + 16 <= n && vmaxvq_u8(vld1q_u8(p + i)) < 0x80) {
+			i += 16;
+		}
+#endif
+		while (i + 8 <= n) {
+			uint64_t word;
+			memcpy(&word, p + i, 8);
+			if ((word & 0x8080808080808080ULL) != 0) {
+				break;
+			}
+			i += 8;
+		}
+		while (i < n && p[i] < 0x80) {
+			i++;
+		}
+		return i;
+	}
+
+	// rejects overlong forms, surrogates and code points above U+10FFFF
+	inline bool validUtf8(const uint8_t* p, size_t n) {
+		size_t i = 0;
+		for (;;) {
+			i += asciiPrefix(p + i, n - i);
+			if (i == n) {
+				return true;
+			}
+			uint8_t c = p[i];
+			size_t length;
+			uint8_t low = 0x80;
+			uint8_t high = 0xbf;
+			if (c >= 0xc2 && c <= 0xdf) {
+				length = 2;
+			} else if (c >= 0xe0 && c <= 0xef) {
+				length = 3;
+				if (c == 0xe0) {
+					low = 0xa0;
+				} else if (c == 0xed) {
+					high = 0x9f;
+				}
+			} else if (c >= 0xf0 && c <= 0xf4) {
+				length = 4;
+				if (c == 0xf0) {
+					low = 0x90;
+				} else if (c == 0xf4) {
+					high = 0x8f;
+				}
+			} else {
+				return false;
+			}
+			if (n - i < length || p[i + 1] < low || p[i + 1] > high) {
+				return false;
+			}
+			for (size_t k = 2; k < length; k++) {
+				if ((p[i + k] & 0xc0) != 0x80) {
+					return false;
+				}
+			}
+			i += length;
+		}
+	}
+
+	// bounds enforced by validate()
+	struct Limits {
+		enum { MaxDepth = 256 };
+		// deepest nesting of arrays and maps, capped at MaxDepth
+		size_t depth;
+		// largest element count of one array or map
+		uint32_t elements;
+		// largest str, bin or ext payload
+		uint32_t length;
+		// reject str payloads that are not valid UTF-8
+		bool utf8;
+		Limits() : depth(64), elements(UINT32_MAX), length(UINT32_MAX), utf8(true) {
+		}
+	};
+
+	// checks that data starts with one well-formed message within limits, in linear time and without allocating.
+	// Returns the length of that message, or 0 if it is malformed.
+	inline size_t validate(const char* data, size_t size, const Limits& limits = Limits()) {
+		uint64_t pending[Limits::MaxDepth + 1];
+		size_t maxDepth = std::min(limits.depth, (size_t)Limits::MaxDepth);
+		size_t depth = 0;
+		pending[0] = 1;
+		const uint8_t* p = (const uint8_t*)data;
+		const uint8_t* end = p + size;
+		for (;;) {
+			while (pending[depth] == 0) {
+				if (depth == 0) {
+					return (const char*)p - data;
+				}
+				depth--;
+			}
+			pending[depth]--;
+			if (p == end) {
+				return 0;
+			}
+			Header header(*p++);
+			if (header.kind == Header::Invalid || (size_t)(end - p) < header.lengthBytes) {
+				return 0;
+			}
+			uint64_t length = header.read(p);
+			p += header.lengthBytes;
+			if (header.kind == Header::Payload) {
+				if ((header.lengthBytes != 0 || header.string) && length > limits.length) {
+					return 0;
+				}
+				if ((uint64_t)(end - p) < length + header.extra) {
+					return 0;
+				}
+				if (header.string && limits.utf8 && !validUtf8(p, (size_t)length)) {
+					return 0;
+				}
+				p += length + header.extra;
+			} else {
+				if (length > limits.elements || depth == maxDepth) {
+					return 0;
+				}
+				uint64_t count = header.kind == Header::Pairs ? length * 2 : length;
+				// every object takes at least one byte
+				if (count > (uint64_t)(end - p)) {
+					return 0;
+				}
+				pending[++depth] = count;
+			}
+		}
+	}
+
+	// element types whose decoding overwrites the whole value, so vector elements can be reused
+	template <class T>
+	struct Reusable : std::integral_constant<bool, std::is_arithmetic<T>::value> {};
+	template <class Traits, class Alloc>
+	struct Reusable<std::basic_string<char, Traits, Alloc> > : std::true_type {};
+
+	// options for unpack(); a bare MemoryResource* converts to the arena option
+	struct UnpackOptions {
+		// arena for std::pmr members of the decoded tree
+		MemoryResource* resource;
+		// skip keys that are not fields of the target type instead of throwing
+		bool skipUnknown;
+		// if set, receives the number of keys skipped in the message
+		size_t* skipped;
+		// if set, the message is checked with validate() before anything is decoded into the target
+		const Limits* limits;
+		UnpackOptions(MemoryResource* resource = NULL) : resource(resource), skipUnknown(false), skipped(NULL), limits(NULL) {
+		}
+	};
+
+	class MapDeserializer {
+	private:
+		Reader& _reader;
+		MemoryResource* _resource;
+		bool _skipUnknown;
+		size_t* _skipped;
+		const Limits* _limits;
+		struct FieldReader {
+			MapDeserializer& deserializer;
+			const Names& names;
+			// a map being read in declaration order
+			struct Cursor {
+				uint32_t length;
+				uint32_t read;
+				// the last key read, when it was not the next field in order
+				const char* key;
+				uint32_t keyLength;
+				bool pending;
+			};
+			template <class... Args>
+			void operator()(Args&... args) {
+				std::tuple<Args&...> fields(args...);
+				parse(fields, typename MakeIndices<sizeof...(Args)>::type());
+			}
+			// decodes field I directly if it is the next key
+			template <size_t I, class Fields>
+			bool inOrder(Fields& fields, Cursor& cursor) {
+				if (cursor.read == cursor.length) {
+					return false;
+				}
+				deserializer._reader.readString(cursor.key, cursor.keyLength);
+				cursor.read++;
+				if (!names.equals(I, cursor.key, cursor.keyLength)) {
+					cursor.pending = true;
+					return false;
+				}
+				deserializer.value(std::get<I>(fields));
+				return true;
+			}
+			template <class Fields, size_t... I>
+			void parse(Fields& fields, Indices<I...> indices) {
+				Reader& reader = deserializer._reader;
+				uint8_t type = reader.peek();
+				if ((type & 0xf0) == 0x90 || type == 0xdc || type == 0xdd) {
+					parsePositional(fields, indices);
+					return;
+				}
+				uint32_t len = reader.readMapHeader();
+				Instrument::visit(len);
+				// our own pack() writes the fields in declaration order; while they come that way each is a direct call
+				Cursor cursor = { len, 0, NULL, 0, false };
+				bool ordered = true;
+				int expand[] = { 0, (ordered = ordered && inOrder<I>(fields, cursor), 0)... };
+				(void)expand;
+				(void)ordered;
+				if (!cursor.pending && cursor.read == len) {
+					return;
+				}
+				// otherwise the remaining keys are looked up and dispatched through a table
+				typedef void (*Decoder)(MapDeserializer&, Fields&);
+				static const Decoder decoders[] = { &MapDeserializer::field<I, Fields>... };
+				size_t expected = cursor.read - (cursor.pending ? 1 : 0);
+				while (cursor.pending || cursor.read < len) {
+					if (!cursor.pending) {
+						reader.readString(cursor.key, cursor.keyLength);
+						cursor.read++;
+					}
+					cursor.pending = false;
+					int index;
+					if (expected < names.size() && names.equals(expected, cursor.key, cursor.keyLength)) {
+						index = (int)expected;
+					} else {
+						index = names.find(cursor.key, cursor.keyLength);
+						if (index < 0) {
+							if (!deserializer._skipUnknown) { throw ca_msgpack::MsgPackError(); }
+							reader.skip();
+							if (deserializer._skipped != NULL) {
+								(*deserializer._skipped)++;
+							}
+							continue;
+						}
+					}
+					expected = index + 1;
+					decoders[index](deserializer, fields);
+				}
+			}
+			// array form written by a positional Writer; trailing fields come from newer producers
+			template <class Fields, size_t... I>
+			void parsePositional(Fields& fields, Indices<I...>) {
+				Reader& reader = deserializer._reader;
+				uint32_t len = reader.readArrayHeader();
+				Instrument::visit(len);
+				int expand[] = { 0, (I < len ? deserializer.value(std::get<I>(fields)), 0 : 0)... };
+				(void)expand;
+				for (uint32_t i = sizeof...(I); i < len; i++) {
+					if (!deserializer._skipUnknown) { throw ca_msgpack::MsgPackError(); }
+					reader.skip();
+					if (deserializer._skipped != NULL) {
+						(*deserializer._skipped)++;
+					}
+				}
+			}
+		};
+		// moves a polymorphic-allocator container onto the arena given to unpack
+		template <class C>
+		void attach(C& obj) {
+#ifdef CA_MSGPACK_PMR
+			if constexpr (std::is_same<typename C::allocator_type, std::pmr::polymorphic_allocator<typename C::value_type> >::value) {
+				if (_resource != nullptr && obj.get_allocator().resource() != _resource) {
+					obj.~C();
+					new (&obj) C(_resource);
+				}
+			}
+#else
+			(void)obj;
+#endif
+		}
+		template <size_t I, class Fields>
+		static void field(MapDeserializer& deserializer, Fields& fields) {
+			deserializer.value(std::get<I>(fields));
+		}
+		void value(int8_t& obj) {
+			obj = _reader.readNumber<int8_t>();
+		}
+		void value(uint8_t& obj) {
+			obj = _reader.readNumber<uint8_t>();
+		}
+		void value(int16_t& obj) {
+			obj = _reader.readNumber<int16_t>();
+		}
+		void value(uint16_t& obj) {
+			obj = _reader.readNumber<uint16_t>();
+		}
+		void value(int32_t& obj) {
+			obj = _reader.readNumber<int32_t>();
+		}
+		void value(uint32_t& obj) {
+			obj = _reader.readNumber<uint32_t>();
+		}
+		void value(int64_t& obj) {
+			obj = _reader.readNumber<int64_t>();
+		}
+		void value(uint64_t& obj) {
+			obj = _reader.readNumber<uint64_t>();
+		}
+		void value(float& obj) {
+			obj = _reader.readNumber<float>();
+		}
+		void value(double& obj) {
+			obj = _reader.readNumber<double>();
+		}
+		void value(bool& obj) {
+			obj = _reader.readBool();
+		}
+		// seconds beyond the range of Duration are rejected before anything is converted
+		template <class Duration>
+		static Duration timestamp(int64_t seconds, uint32_t nanoseconds, std::true_type) {
+			const std::chrono::seconds most = std::chrono::duration_cast<std::chrono::seconds>(Duration::max());
+			const std::chrono::seconds least = std::chrono::duration_cast<std::chrono::seconds>(Duration::min());
+			Duration fraction = std::chrono::duration_cast<Duration>(std::chrono::nanoseconds(nanoseconds));
+			if (seconds > most.count() || seconds < least.count() - 1) {
+				throw ca_msgpack::MsgPackError();
+			}
+			if (seconds == most.count() && fraction > Duration::max() - most) {
+				throw ca_msgpack::MsgPackError();
+			}
+			if (seconds == least.count() - 1) {
+				// the second below least, counted down from least
+				Duration below = std::chrono::seconds(1) - fraction;
+				if (below > least - Duration::min()) {
+					throw ca_msgpack::MsgPackError();
+				}
+				return Duration(least) - below;
+			}
+			return Duration(std::chrono::seconds(seconds)) + fraction;
+		}
+		// a second or coarser, or floating point: the conversion cannot overflow
+		template <class Duration>
+		static Duration timestamp(int64_t seconds, uint32_t nanoseconds, std::false_type) {
+			return std::chrono::duration_cast<Duration>(std::chrono::seconds(seconds)) +
+				std::chrono::duration_cast<Duration>(std::chrono::nanoseconds(nanoseconds));
+		}
+		template <class Duration>
+		void value(std::chrono::time_point<std::chrono::system_clock, Duration>& obj) {
+			int64_t seconds;
+			uint32_t nanoseconds;
+			_reader.readTimestamp(seconds, nanoseconds);
+			obj = std::chrono::time_point<std::chrono::system_clock, Duration>(timestamp<Duration>(seconds, nanoseconds, SubSecond<Duration>()));
+		}
+#ifdef CA_MSGPACK_CXX17
+		template <class T>
+		void value(std::optional<T>& obj) {
+			if (_reader.peek() == 0xc0) {
+				_reader.readNil();
+				obj.reset();
+				return;
+			}
+			if (!obj) {
+				obj.emplace();
+			}
+			value(*obj);
+		}
+#endif
+		template <class Traits, class Alloc>
+		void value(std::basic_string<char, Traits, Alloc>& obj) {
+			const char* data;
+			uint32_t length;
+			_reader.readString(data, length);
+			attach(obj);
+			obj.assign(data, length);
+		}
+#ifdef CA_MSGPACK_CXX17
+		void value(std::string_view& obj) {
+			if (!_reader.borrowable()) { throw ca_msgpack::MsgPackError(); }
+			const char* data;
+			uint32_t length;
+			_reader.readString(data, length);
+			obj = std::string_view(data, length);
+		}
+#endif
+		void value(BytesView& obj) {
+			if (!_reader.borrowable()) { throw ca_msgpack::MsgPackError(); }
+			const char* data;
+			uint32_t length;
+			_reader.readBin(data, length);
+			obj = BytesView(data, length);
+		}
+		template <class Alloc>
+		void value(std::vector<uint8_t, Alloc>& obj) {
+			const char* data;
+			uint32_t length;
+			_reader.readBin(data, length);
+			attach(obj);
+			obj.assign((const uint8_t*)data, (const uint8_t*)data + length);
+		}
+		template <class T, size_t N>
+		void value(std::array<T, N>& array) {
+			uint32_t len = _reader.readArrayHeader();
+			Instrument::visit(len);
+			if (len != N) { throw ca_msgpack::MsgPackError(); }
+			parseElements(array, std::integral_constant<bool, NumberFormat<T>::enabled>());
+		}
+		template <class T, class Alloc>
+		void value(std::vector<T, Alloc>& array) {
+			uint32_t len = _reader.readArrayHeader();
+			Instrument::visit(len);
+			// every element takes at least one byte, so a larger count is malformed
+			if (len > _reader.remaining()) { throw ca_msgpack::MsgPackError(); }
+			attach(array);
+			if (!Reusable<T>::value) {
+				array.clear();
+			}
+			array.resize(len);
+			parseElements(array, std::integral_constant<bool, NumberFormat<T>::enabled>());
+		}
+		template <class Traits, class KeyAlloc, class T, class Compare, class Alloc>
+		void value(std::map<std::basic_string<char, Traits, KeyAlloc>, T, Compare, Alloc>& map) {
+			uint32_t len = _reader.readMapHeader();
+			Instrument::visit(len);
+			if (len > _reader.remaining() / 2) { throw ca_msgpack::MsgPackError(); }
+			attach(map);
+			map.clear();
+			for (uint32_t i = 0; i < len; i++) {
+				const char* key;
+				uint32_t length;
+				_reader.readString(key, length);
+				T& obj = map.emplace_hint(map.end(), std::piecewise_construct,
+					std::forward_as_tuple(key, length), std::forward_as_tuple())->second;
+				value(obj);
+			}
+		}
+		template <class M>
+		static void reserve(M&, size_t) {
+		}
+		template <class Key, class T, class Hash, class Equal, class Alloc>
+		static void reserve(std::unordered_map<Key, T, Hash, Equal, Alloc>& map, size_t size) {
+			map.reserve(size);
+		}
+		// maps with keys of any supported type; a repeated key keeps the last value
+		template <class M>
+		void parseEntries(M& map) {
+			uint32_t len = _reader.readMapHeader();
+			Instrument::visit(len);
+			if (len > _reader.remaining() / 2) { throw ca_msgpack::MsgPackError(); }
+			attach(map);
+			map.clear();
+			reserve(map, len);
+			for (uint32_t i = 0; i < len; i++) {
+				typename M::key_type key;
+				value(key);
+				typename M::mapped_type& obj = map.emplace(std::piecewise_construct,
+					std::forward_as_tuple(std::move(key)), std::forward_as_tuple()).first->second;
+				value(obj);
+			}
+		}
+		template <class Key, class T, class Compare, class Alloc>
+		void value(std::map<Key, T, Compare, Alloc>& map) {
+			parseEntries(map);
+		}
+		template <class Key, class T, class Hash, class Equal, class Alloc>
+		void value(std::unordered_map<Key, T, Hash, Equal, Alloc>& map) {
+			parseEntries(map);
+		}
+		template <class T>
+		void value(T& obj) {
+			parseObject(obj);
+		}
+		template <class V>
+		void parseElements(V& array, std::true_type) {
+			_reader.readNumbers(array.data(), array.size());
+		}
+		template <class V>
+		void parseElements(V& array, std::false_type) {
+			for (size_t i = 0; i < array.size(); i++) {
+				value(array[i]);
+			}
+		}
+	public:
+		MapDeserializer(Reader& reader, const UnpackOptions& options = UnpackOptions()) : _reader(reader), _resource(options.resource),
+			_skipUnknown(options.skipUnknown), _skipped(options.skipped), _limits(options.limits) {
+		}
+		template <class T>
+		void parseObject(T& obj) {
+			UnpackProbe<T> probe(_reader);
+			obj.msgpackFields(FieldReader{ *this, T::msgpackNames() });
+		}
+		// decodes any supported type at the reader's position
+		template <class T>
+		void read(T& obj) {
+			value(obj);
+		}
+		template <class T>
+		void execute(T& obj) {
+			if (_skipped != NULL) {
+				*_skipped = 0;
+			}
+			if (_limits != NULL && validate(_reader.position(), _reader.remaining(), *_limits) == 0) {
+				throw ca_msgpack::MsgPackError();
+			}
+			parseObject(obj);
+		}
+	};
+
+	// converts a netLink element stream into bytes for the MsgPack::Deserializer overloads
+	template <class T>
+	void unpack(T& obj, MsgPack::Deserializer& deserializer) {
+		Element element;
+		deserializer.deserialize(element, true);
+		if (!element) { throw ca_msgpack::MsgPackError(); }
+		std::stringbuf sb;
+		MsgPack::Serializer serializer(&sb);
+		serializer << element;
+		const std::string& packed = sb.str();
+		Reader reader(packed.data(), packed.size(), false);
+		obj.unpack(reader);
+	}
+
+	// splits a byte stream that arrives in arbitrary chunks into whole messages.
+	// Each byte is walked once; headers are tracked with a count of objects still pending,
+	// so a message cut anywhere resumes where the previous feed() stopped.
+	class Unpacker {
+	public:
+		enum Status { NeedMore, Complete, Error };
+	private:
+		std::string _buffer;
+		size_t _begin;
+		size_t _cursor;
+		uint64_t _pending;
+		size_t _maxSize;
+		Status _status;
+		// walks one header at _cursor; false when its length bytes have not arrived yet
+		bool step() {
+			const uint8_t* p = (const uint8_t*)_buffer.data() + _cursor;
+			size_t available = _buffer.size() - _cursor;
+			Header header(p[0]);
+			if (header.kind == Header::Invalid) {
+				_status = Error;
+				return true;
+			}
+			if (available < 1 + header.lengthBytes) {
+				return false;
+			}
+			uint64_t length = header.read(p + 1);
+			_pending--;
+			_cursor += 1 + header.lengthBytes;
+			if (header.kind == Header::Payload) {
+				_cursor += length + header.extra;
+			} else {
+				_pending += header.kind == Header::Pairs ? length * 2 : length;
+			}
+			// every pending object takes at least one byte
+			if (_cursor - _begin + _pending > _maxSize) {
+				_status = Error;
+			}
+			return true;
+		}
+		void compact() {
+			if (_begin > 0) {
+				_buffer.erase(0, _begin);
+				_cursor -= _begin;
+				_begin = 0;
+			}
+		}
+	public:
+		// maxSize bounds a single message, so a hostile header cannot make the buffer grow without limit
+		explicit Unpacker(size_t maxSize = 64 << 20) : _begin(0), _cursor(0), _pending(1), _maxSize(maxSize), _status(NeedMore) {
+		}
+		// appends the next chunk of the stream
+		void feed(const char* data, size_t length) {
+			compact();
+			_buffer.append(data, length);
+		}
+		// reads up to length bytes from sb straight into the buffer; returns how many arrived
+		size_t feed(std::streambuf* sb, size_t length) {
+			compact();
+			size_t size = _buffer.size();
+			_buffer.resize(size + length);
+			std::streamsize n = sb->sgetn(&_buffer[size], length);
+			_buffer.resize(size + (n > 0 ? (size_t)n : 0));
+			return n > 0 ? (size_t)n : 0;
+		}
+		// bytes fed but not yet popped
+		size_t buffered() const {
+			return _buffer.size() - _begin;
+		}
+		// Complete once a whole message is buffered; it stays Complete until that message is unpacked
+		Status next() {
+			while (_status == NeedMore && _pending != 0) {
+				if (_cursor >= _buffer.size() || !step()) {
+					return _status;
+				}
+			}
+			if (_status == NeedMore && _cursor <= _buffer.size()) {
+				_status = Complete;
+			}
+			return _status;
+		}
+		// the complete message
+		const char* data() const {
+			return _buffer.data() + _begin;
+		}
+		size_t size() const {
+			return _status == Complete ? _cursor - _begin : 0;
+		}
+		// decodes the complete message into obj and moves on to the next one, even if decoding throws
+		template <class T>
+		void unpack(T& obj, const UnpackOptions& options = UnpackOptions()) {
+			if (_status != Complete) { throw ca_msgpack::MsgPackError(); }
+			Reader reader(data(), size(), false);
+			pop();
+			obj.unpack(reader, options);
+		}
+		// drops the complete message without decoding it
+		void pop() {
+			if (_status != Complete) { throw ca_msgpack::MsgPackError(); }
+			_begin = _cursor;
+			_pending = 1;
+			_status = NeedMore;
+		}
+		// forgets all buffered bytes, including after an Error
+		void reset() {
+			_buffer.clear();
+			_begin = _cursor = 0;
+			_pending = 1;
+			_status = NeedMore;
+		}
+	};
+
+	// writes a sequence of T records to sb, handing them over in batches of about batchSize bytes
+	template <class T>
+	class StreamWriter {
+	private:
+		std::streambuf* _sb;
+		std::string _buffer;
+		size_t _batchSize;
+		bool _positional;
+		StreamWriter(const StreamWriter&);
+		StreamWriter& operator=(const StreamWriter&);
+	public:
+		explicit StreamWriter(std::streambuf* sb, size_t batchSize = 64 << 10) : _sb(sb), _batchSize(batchSize), _positional(false) {
+			_buffer.reserve(batchSize);
+		}
+		~StreamWriter() {
+			try { flush(); } catch (...) {}
+		}
+		// see Writer::setPositional
+		void setPositional(bool positional) {
+			_positional = positional;
+		}
+		void write(const T& obj) {
+			size_t size = _buffer.size();
+			try {
+				Writer writer(_buffer);
+				writer.setPositional(_positional);
+				obj.pack(writer);
+			} catch (...) {
+				// the writer hands over what it has when destroyed; drop the partial record so later records stay framed
+				_buffer.resize(size);
+				throw;
+			}
+			if (_buffer.size() >= _batchSize) {
+				flush();
+			}
+		}
+		void flush() {
+			std::streamsize length = _buffer.size();
+			if (length == 0) {
+				return;
+			}
+			if (_sb->sputn(_buffer.data(), length) != length) {
+				throw ca_msgpack::MsgPackError();
+			}
+			_buffer.clear();
+		}
+	};
+
+	// reads a sequence of T records from sb, keeping its buffer across records
+	template <class T>
+	class StreamReader {
+	private:
+		std::streambuf* _sb;
+		Unpacker _unpacker;
+		size_t _chunkSize;
+		UnpackOptions _options;
+	public:
+		explicit StreamReader(std::streambuf* sb, const UnpackOptions& options = UnpackOptions(), size_t chunkSize = 64 << 10)
+			: _sb(sb), _chunkSize(chunkSize), _options(options) {
+		}
+		// false at the end of the stream; a record cut short by the end throws
+		bool read(T& obj) {
+			for (;;) {
+				Unpacker::Status status = _unpacker.next();
+				if (status == Unpacker::Complete) {
+					_unpacker.unpack(obj, _options);
+					return true;
+				} else if (status == Unpacker::Error) {
+					throw ca_msgpack::MsgPackError();
+				}
+				if (_unpacker.feed(_sb, _chunkSize) == 0) {
+					if (_unpacker.buffered() != 0) { throw ca_msgpack::MsgPackError(); }
+					return false;
+				}
+			}
+		}
+	};
+
+#ifdef CA_MSGPACK_MMAP
+	// read-only mapping of a file of concatenated records, with an index of where each one starts.
+	// Records are decoded in place, so views into them stay valid while the file is mapped.
+	class MappedFile {
+	public:
+		// records [first, last)
+		struct Range {
+			size_t first;
+			size_t last;
+		};
+	private:
+		const char* _data;
+		size_t _size;
+		std::vector<uint64_t> _offsets;
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+	public:
+		explicit MappedFile(const char* path) : _data(NULL), _size(0) {
+			int fd = open(path, O_RDONLY);
+			if (fd < 0) { throw ca_msgpack::MsgPackError(); }
+			struct stat st;
+			if (fstat(fd, &st) != 0) {
+				close(fd);
+				throw ca_msgpack::MsgPackError();
+			}
+			_size = (size_t)st.st_size;
+			if (_size != 0) {
+				void* p = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p == MAP_FAILED) {
+					close(fd);
+					throw ca_msgpack::MsgPackError();
+				}
+				_data = (const char*)p;
+			}
+			close(fd);
+			_offsets.push_back(0);
+		}
+		~MappedFile() {
+			if (_data != NULL) {
+				munmap((void*)_data, _size);
+			}
+		}
+		const char* data() const {
+			return _data;
+		}
+		size_t size() const {
+			return _size;
+		}
+		// number of indexed records
+		size_t count() const {
+			return _offsets.size() - 1;
+		}
+		// walks the record headers once; nothing is decoded. A truncated record throws and leaves the index as it was
+		void buildIndex() {
+			std::vector<uint64_t> offsets(1, 0);
+			Reader reader(_data, _size);
+			while (reader.remaining() != 0) {
+				reader.skip();
+				offsets.push_back(reader.position() - _data);
+			}
+			_offsets.swap(offsets);
+		}
+		// the index is a MessagePack array of the file size followed by every record size
+		void saveIndex(const char* path) const {
+			if (_offsets.size() > UINT32_MAX) { throw ca_msgpack::MsgPackError(); }
+			std::filebuf fb;
+			if (fb.open(path, std::ios::out | std::ios::binary | std::ios::trunc) == NULL) { throw ca_msgpack::MsgPackError(); }
+			Writer writer(&fb);
+			writer.writeArrayHeader((uint32_t)_offsets.size());
+			writer.writeUInt(_size);
+			for (size_t i = 1; i < _offsets.size(); i++) {
+				writer.writeUInt(_offsets[i] - _offsets[i - 1]);
+			}
+			writer.flush();
+		}
+		// false if the index is missing, malformed or was built for a different file
+		bool loadIndex(const char* path) {
+			std::filebuf fb;
+			if (fb.open(path, std::ios::in | std::ios::binary) == NULL) {
+				return false;
+			}
+			try {
+				std::string buffer;
+				readMessage(&fb, buffer);
+				Reader reader(buffer.data(), buffer.size());
+				uint32_t len = reader.readArrayHeader();
+				if (len == 0 || len > reader.remaining() || reader.readNumber<uint64_t>() != _size) {
+					return false;
+				}
+				std::vector<uint64_t> offsets;
+				offsets.reserve(len);
+				offsets.push_back(0);
+				for (uint32_t i = 1; i < len; i++) {
+					uint64_t size = reader.readNumber<uint64_t>();
+					if (size == 0 || size > _size - offsets.back()) {
+						return false;
+					}
+					offsets.push_back(offsets.back() + size);
+				}
+				if (offsets.back() != _size) {
+					return false;
+				}
+				_offsets.swap(offsets);
+				return true;
+			} catch (ca_msgpack::MsgPackError&) {
+				return false;
+			}
+		}
+		const char* record(size_t ordinal) const {
+			return _data + _offsets[ordinal];
+		}
+		size_t recordSize(size_t ordinal) const {
+			return _offsets[ordinal + 1] - _offsets[ordinal];
+		}
+		template <class T>
+		void read(size_t ordinal, T& obj, const UnpackOptions& options = UnpackOptions()) const {
+			if (ordinal >= count()) { throw ca_msgpack::MsgPackError(); }
+			obj.unpack(record(ordinal), recordSize(ordinal), options);
+		}
+		// splits the records into at most parts ranges of about the same number of bytes
+		std::vector<Range> split(size_t parts) const {
+			std::vector<Range> ranges;
+			size_t first = 0;
+			for (size_t i = 1; i <= parts && first < count(); i++) {
+				size_t last = count();
+				if (i < parts) {
+					uint64_t target = (uint64_t)(_size / parts) * i;
+					last = std::lower_bound(_offsets.begin() + first, _offsets.end() - 1, target) - _offsets.begin();
+					last = std::max(last, first + 1);
+				}
+				Range range = { first, last };
+				ranges.push_back(range);
+				first = last;
+			}
+			return ranges;
+		}
+	};
+#endif
+
+	// fixed set of threads running batches of indexed work.
+	// Every worker starts with an equal slice of the indices; one that runs dry steals half of what another has left.
+	class ThreadPool {
+	public:
+		// task(worker, begin, end) handles indices [begin, end); worker < size()
+		typedef std::function<void(size_t, size_t, size_t)> Task;
+	private:
+		struct Queue {
+			std::mutex mutex;
+			size_t begin;
+			size_t end;
+		};
+		size_t _size;
+		std::unique_ptr<Queue[]> _queues;
+		std::vector<std::thread> _threads;
+		std::mutex _mutex;
+		std::condition_variable _start;
+		std::condition_variable _done;
+		uint64_t _generation;
+		size_t _running;
+		bool _stop;
+		const Task* _task;
+		size_t _grain;
+		std::exception_ptr _error;
+		ThreadPool(const ThreadPool&);
+		ThreadPool& operator=(const ThreadPool&);
+		bool take(size_t worker, size_t& begin, size_t& end) {
+			Queue& own = _queues[worker];
+			for (;;) {
+				{
+					std::lock_guard<std::mutex> lock(own.mutex);
+					if (own.begin < own.end) {
+						begin = own.begin;
+						end = std::min(own.end, begin + _grain);
+						own.begin = end;
+						return true;
+					}
+				}
+				bool stolen = false;
+				for (size_t i = 1; i < _size && !stolen; i++) {
+					Queue& victim = _queues[(worker + i) % _size];
+					std::lock_guard<std::mutex> lock(victim.mutex);
+					size_t left = victim.end - victim.begin;
+					if (left != 0) {
+						size_t half = (left + 1) / 2;
+						victim.end -= half;
+						begin = victim.end;
+						end = begin + half;
+						stolen = true;
+					}
+				}
+				if (!stolen) {
+					return false;
+				}
+				std::lock_guard<std::mutex> lock(own.mutex);
+				own.begin = begin;
+				own.end = end;
+			}
+		}
+		void work(size_t worker) {
+			size_t begin;
+			size_t end;
+			while (take(worker, begin, end)) {
+				try {
+					(*_task)(worker, begin, end);
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(_mutex);
+					if (!_error) {
+						_error = std::current_exception();
+					}
+				}
+			}
+		}
+		void loop(size_t worker) {
+			uint64_t generation = 0;
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					while (!_stop && _generation == generation) {
+						_start.wait(lock);
+					}
+					if (_stop) {
+						return;
+					}
+					generation = _generation;
+				}
+				work(worker);
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (--_running == 0) {
+					_done.notify_one();
+				}
+			}
+		}
+	public:
+		// the calling thread is worker 0, so size - 1 threads are started
+		explicit ThreadPool(size_t size = std::thread::hardware_concurrency()) : _size(std::max(size, (size_t)1)),
+			_queues(new Queue[_size]), _generation(0), _running(0), _stop(false), _task(NULL), _grain(1) {
+			for (size_t i = 1; i < _size; i++) {
+				_threads.push_back(std::thread(&ThreadPool::loop, this, i));
+			}
+		}
+		~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stop = true;
+			}
+			_start.notify_all();
+			for (size_t i = 0; i < _threads.size(); i++) {
+				_threads[i].join();
+			}
+		}
+		size_t size() const {
+			return _size;
+		}
+		// runs task over [0, count) in pieces of at most grain indices; the first exception thrown is rethrown here
+		void run(size_t count, size_t grain, const Task& task) {
+			std::unique_lock<std::mutex> lock(_mutex);
+			for (size_t i = 0; i < _size; i++) {
+				_queues[i].begin = count * i / _size;
+				_queues[i].end = count * (i + 1) / _size;
+			}
+			_task = &task;
+			_grain = std::max(grain, (size_t)1);
+			_error = std::exception_ptr();
+			_running = _threads.size();
+			_generation++;
+			lock.unlock();
+			_start.notify_all();
+			work(0);
+			lock.lock();
+			while (_running != 0) {
+				_done.wait(lock);
+			}
+			_task = NULL;
+			if (_error) {
+				std::exception_ptr error = _error;
+				_error = std::exception_ptr();
+				std::rethrow_exception(error);
+			}
 		}
 	};
+
+	// packs and unpacks many independent records at once on a ThreadPool.
+	// Each worker encodes into its own scratch buffer, kept across batches.
+	class Batch {
+	private:
+		struct Location {
+			size_t worker;
+			size_t offset;
+			size_t size;
+		};
+		ThreadPool _pool;
+		std::vector<std::string> _scratch;
+		std::vector<Location> _locations;
+		bool _positional;
+#ifdef CA_MSGPACK_PMR
+		// one per worker, only allocated from by that worker; deallocation is a no-op, so any thread may free into it
+		std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource> > _arenas;
+#endif
+		size_t grain(size_t count) const {
+			return count / (_pool.size() * 16) + 1;
+		}
+	public:
+		explicit Batch(size_t threads = std::thread::hardware_concurrency()) : _pool(threads), _scratch(_pool.size()), _positional(false) {
+		}
+		size_t threads() const {
+			return _pool.size();
+		}
+		// see Writer::setPositional
+		void setPositional(bool positional) {
+			_positional = positional;
+		}
+#ifdef CA_MSGPACK_PMR
+		// when set, unpack() places the std::pmr members of each record on an arena of the worker that decodes it,
+		// instead of options.resource. The arenas only grow until releaseArenas().
+		void setArenas(bool arenas) {
+			_arenas.clear();
+			for (size_t i = 0; arenas && i < _pool.size(); i++) {
+				_arenas.emplace_back(new std::pmr::monotonic_buffer_resource());
+			}
+		}
+		// frees the arenas; no object decoded since the last release may be used or destroyed afterwards
+		void releaseArenas() {
+			for (auto& arena : _arenas) {
+				arena->release();
+			}
+		}
+#endif
+		// packs objects[0, count) back to back into output; record i is [offsets[i], offsets[i + 1])
+		template <class T>
+		void pack(const T* objects, size_t count, std::string& output, std::vector<uint64_t>& offsets) {
+			_locations.resize(count);
+			for (size_t i = 0; i < _scratch.size(); i++) {
+				_scratch[i].clear();
+			}
+			ThreadPool::Task encode = [&](size_t worker, size_t begin, size_t end) {
+				std::string& scratch = _scratch[worker];
+				size_t base = scratch.size();
+				size_t packed = base;
+				try {
+					Writer writer(scratch);
+					writer.setPositional(_positional);
+					for (size_t i = begin; i < end; i++) {
+						size_t offset = writer.size();
+						objects[i].pack(writer);
+						Location location = { worker, base + offset, writer.size() - offset };
+						_locations[i] = location;
+						packed = base + writer.size();
+					}
+				} catch (...) {
+					// cut off the partial record the writer flushed while unwinding
+					scratch.resize(packed);
+					throw;
+				}
+			};
+			_pool.run(count, grain(count), encode);
+			offsets.resize(count + 1);
+			offsets[0] = 0;
+			for (size_t i = 0; i < count; i++) {
+				offsets[i + 1] = offsets[i] + _locations[i].size;
+			}
+			output.resize(offsets[count]);
+			ThreadPool::Task gather = [&](size_t, size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					const Location& location = _locations[i];
+					memcpy(&output[offsets[i]], _scratch[location.worker].data() + location.offset, location.size);
+				}
+			};
+			_pool.run(count, grain(count), gather);
+		}
+		// unpacks record i, [offsets[i], offsets[i + 1]) of data, into objects[i] for i in [0, count).
+		// options.skipped is per message, so it is not reported here.
+		template <class T>
+		void unpack(const char* data, const uint64_t* offsets, T* objects, size_t count, const UnpackOptions& options = UnpackOptions()) {
+			UnpackOptions shared = options;
+			shared.skipped = NULL;
+			ThreadPool::Task decode = [&](size_t worker, size_t begin, size_t end) {
+				UnpackOptions local = shared;
+#ifdef CA_MSGPACK_PMR
+				if (!_arenas.empty()) {
+					local.resource = _arenas[worker].get();
+				}
+#else
+				(void)worker;
+#endif
+				for (size_t i = begin; i < end; i++) {
+					objects[i].unpack(data + offsets[i], (size_t)(offsets[i + 1] - offsets[i]), local);
+				}
+			};
+			_pool.run(count, grain(count), decode);
+		}
+	};
+
+	// lazy access to a packed T. The first access records where each top-level field starts,
+	// skipping over the values; after that a field is decoded only when it is read.
+	// The buffer must outlive the view and every view taken from it. Not thread-safe.
+	template <class T>
+	class View {
+	private:
+		static const size_t Absent = (size_t)-1;
+		static const size_t InlineFields = 32;
+		const char* _data;
+		size_t _size;
+		mutable bool _indexed;
+		mutable size_t _inline[InlineFields];
+		mutable std::vector<size_t> _heap;
+		struct Locator {
+			const void* target;
+			size_t index;
+			template <class... Args>
+			void operator()(const Args&... args) {
+				size_t i = 0;
+				int expand[] = { 0, ((const void*)&args == target ? (void)(index = i) : (void)0, i++, 0)... };
+				(void)expand;
+			}
+		};
+		template <class M>
+		static size_t indexOf(M T::* member) {
+			static const T probe = T();
+			Locator locator = { &(probe.*member), Absent };
+			probe.msgpackFields(locator);
+			if (locator.index == Absent) { throw ca_msgpack::MsgPackError(); }
+			return locator.index;
+		}
+		size_t* offsets() const {
+			return _heap.empty() ? _inline : _heap.data();
+		}
+		void index() const {
+			const Names& names = T::msgpackNames();
+			if (names.size() > InlineFields) {
+				_heap.assign(names.size(), Absent);
+			} else {
+				std::fill(_inline, _inline + names.size(), Absent);
+			}
+			size_t* table = offsets();
+			Reader reader(_data, _size);
+			uint8_t type = reader.peek();
+			if ((type & 0xf0) == 0x90 || type == 0xdc || type == 0xdd) {
+				uint32_t len = reader.readArrayHeader();
+				for (uint32_t i = 0; i < len; i++) {
+					if (i < names.size()) {
+						table[i] = reader.position() - _data;
+					}
+					reader.skip();
+				}
+			} else {
+				uint32_t len = reader.readMapHeader();
+				size_t expected = 0;
+				for (uint32_t i = 0; i < len; i++) {
+					const char* key;
+					uint32_t length;
+					reader.readString(key, length);
+					int found = expected < names.size() && names.equals(expected, key, length) ? (int)expected : names.find(key, length);
+					if (found >= 0) {
+						table[found] = reader.position() - _data;
+						expected = found + 1;
+					}
+					reader.skip();
+				}
+			}
+			_indexed = true;
+		}
+		// reader at the value of member, or false if the message does not have it
+		template <class M>
+		bool locate(M T::* member, Reader& reader) const {
+			if (!_indexed) {
+				index();
+			}
+			size_t offset = offsets()[indexOf(member)];
+			if (offset == Absent) {
+				return false;
+			}
+			reader = Reader(_data + offset, _size - offset);
+			return true;
+		}
+		template <class C>
+		static void load(Reader& reader, View<C>& out) {
+			out = View<C>(reader.position(), reader.remaining());
+		}
+		template <class E>
+		static void load(Reader& reader, E& out) {
+			MapDeserializer deserializer(reader);
+			deserializer.read(out);
+		}
+	public:
+		View() : _data(NULL), _size(0), _indexed(false) {
+		}
+		View(const char* data, size_t size) : _data(data), _size(size), _indexed(false) {
+		}
+		View(const View& other) : _data(other._data), _size(other._size), _indexed(false) {
+		}
+		View& operator=(const View& other) {
+			_data = other._data;
+			_size = other._size;
+			_indexed = false;
+			_heap.clear();
+			return *this;
+		}
+		template <class M>
+		bool has(M T::* member) const {
+			Reader reader(NULL, 0);
+			return locate(member, reader);
+		}
+		// decodes member into out, or into a View when member is itself a CA_MSGPACK object
+		template <class M, class Out>
+		bool get(M T::* member, Out& out) const {
+			static_assert(std::is_same<Out, M>::value || std::is_same<Out, View<M> >::value, "out must be the member type or a View of it");
+			Reader reader(NULL, 0);
+			if (!locate(member, reader)) {
+				return false;
+			}
+			load(reader, out);
+			return true;
+		}
+		// number of elements of an array or map member
+		template <class M>
+		size_t size(M T::* member) const {
+			Reader reader(NULL, 0);
+			if (!locate(member, reader)) {
+				return 0;
+			}
+			uint8_t type = reader.peek();
+			if ((type & 0xf0) == 0x90 || type == 0xdc || type == 0xdd) {
+				return reader.readArrayHeader();
+			}
+			return reader.readMapHeader();
+		}
+		// decodes element index of a vector member, skipping the ones before it
+		template <class E, class Alloc, class Out>
+		bool at(std::vector<E, Alloc> T::* member, size_t index, Out& out) const {
+			static_assert(std::is_same<Out, E>::value || std::is_same<Out, View<E> >::value, "out must be the element type or a View of it");
+			Reader reader(NULL, 0);
+			if (!locate(member, reader)) {
+				return false;
+			}
+			uint32_t len = reader.readArrayHeader();
+			if (index >= len) {
+				return false;
+			}
+			for (size_t i = 0; i < index; i++) {
+				reader.skip();
+			}
+			load(reader, out);
+			return true;
+		}
+		// decodes the value stored under key in a map member, skipping the other values
+		template <class Traits, class KeyAlloc, class E, class Compare, class Alloc, class Out>
+		bool find(std::map<std::basic_string<char, Traits, KeyAlloc>, E, Compare, Alloc> T::* member, const char* key, size_t length, Out& out) const {
+			static_assert(std::is_same<Out, E>::value || std::is_same<Out, View<E> >::value, "out must be the value type or a View of it");
+			Reader reader(NULL, 0);
+			if (!locate(member, reader)) {
+				return false;
+			}
+			uint32_t len = reader.readMapHeader();
+			for (uint32_t i = 0; i < len; i++) {
+				const char* data;
+				uint32_t size;
+				reader.readString(data, size);
+				if (size == length && memcmp(data, key, length) == 0) {
+					load(reader, out);
+					return true;
+				}
+				reader.skip();
+			}
+			return false;
+		}
+		template <class Traits, class KeyAlloc, class E, class Compare, class Alloc, class Out>
+		bool find(std::map<std::basic_string<char, Traits, KeyAlloc>, E, Compare, Alloc> T::* member, const std::string& key, Out& out) const {
+			return find(member, key.data(), key.size(), out);
+		}
+	};
+	template <class T>
+	const size_t View<T>::Absent;
+	template <class T>
+	const size_t View<T>::InlineFields;
 }
 
 #define CA_MSGPACK(...)									\
 void pack(std::streambuf* sb) const { \
-	MsgPack::Serializer s(sb); \
-	pack(s); \
+	ca_msgpack::Writer writer(sb); \
+	pack(writer); \
+	writer.flush(); \
 } \
 void pack(MsgPack::Serializer& serializer) const { \
-	ca_msgpack::MapSerializer mapSerializer(serializer, BOOST_PP_VARIADIC_SIZE(__VA_ARGS__)); \
-	BOOST_PP_CAT(BOOST_PP_CAT(MSGPACK_SER_, BOOST_PP_VARIADIC_SIZE(__VA_ARGS__)) (__VA_ARGS__),) \
-}\
-void unpack(std::streambuf* sb) { \
-	MsgPack::Deserializer d(sb); \
-	unpack(d); \
+	ca_msgpack::pack(*this, serializer); \
+} \
+void pack(ca_msgpack::Writer& writer) const { \
+	ca_msgpack::PackProbe<decltype(*this)> probe(writer); \
+	ca_msgpack::MapSerializer mapSerializer(writer); \
+	mapSerializer.serializeObject(*this); \
+} \
+void unpack(std::streambuf* sb, const ca_msgpack::UnpackOptions& options = ca_msgpack::UnpackOptions()) { \
+	std::string buffer; \
+	ca_msgpack::readMessage(sb, buffer); \
+	ca_msgpack::Reader reader(buffer.data(), buffer.size(), false); \
+	unpack(reader, options); \
 } \
 void unpack(MsgPack::Deserializer& deserializer) { \
-	ca_msgpack::MapDeserializer mapDeserializer(deserializer); \
-	addMembers(mapDeserializer); \
-	mapDeserializer.execute(); \
+	ca_msgpack::unpack(*this, deserializer); \
 } \
-void addMembers(ca_msgpack::MapDeserializer& mapDeserializer, const char* key = "") { \
-	BOOST_PP_CAT(BOOST_PP_CAT(MSGPACK_DES_, BOOST_PP_VARIADIC_SIZE(__VA_ARGS__)) (__VA_ARGS__),) \
+void unpack(const char* data, size_t length, const ca_msgpack::UnpackOptions& options = ca_msgpack::UnpackOptions()) { \
+	ca_msgpack::Reader reader(data, length); \
+	unpack(reader, options); \
 } \
-static void addMemberArray(ca_msgpack::Element&, const char*, void*) { \
+void unpack(ca_msgpack::Reader& reader, const ca_msgpack::UnpackOptions& options = ca_msgpack::UnpackOptions()) { \
+	ca_msgpack::MapDeserializer mapDeserializer(reader, options); \
+	mapDeserializer.execute(*this); \
 } \
-static void addMemberMap(ca_msgpack::Element&, const char*, void*) { \
+static const ca_msgpack::Names& msgpackNames() { \
+	static const ca_msgpack::Names names(#__VA_ARGS__); \
+	return names; \
 } \
-
-#define MSGPACK_SER(x)									mapSerializer.serialize(#x, x);
-#define MSGPACK_SER_1(x)								MSGPACK_SER(x)
-#define MSGPACK_SER_2(x, ...)						MSGPACK_SER(x) MSGPACK_SER_1 (__VA_ARGS__)
-#define MSGPACK_SER_3(x, ...)						MSGPACK_SER(x) MSGPACK_SER_2 (__VA_ARGS__)
-#define MSGPACK_SER_4(x, ...)						MSGPACK_SER(x) MSGPACK_SER_3 (__VA_ARGS__)
-#define MSGPACK_SER_5(x, ...)						MSGPACK_SER(x) MSGPACK_SER_4 (__VA_ARGS__)
-#define MSGPACK_SER_6(x, ...)						MSGPACK_SER(x) MSGPACK_SER_5 (__VA_ARGS__)
-#define MSGPACK_SER_7(x, ...)						MSGPACK_SER(x) MSGPACK_SER_6 (__VA_ARGS__)
-#define MSGPACK_SER_8(x, ...)						MSGPACK_SER(x) MSGPACK_SER_7 (__VA_ARGS__)
-#define MSGPACK_SER_9(x, ...)						MSGPACK_SER(x) MSGPACK_SER_8 (__VA_ARGS__)
-#define MSGPACK_SER_10(x, ...)					MSGPACK_SER(x) MSGPACK_SER_9 (__VA_ARGS__)
-#define MSGPACK_SER_11(x, ...)					MSGPACK_SER(x) MSGPACK_SER_10(__VA_ARGS__)
-#define MSGPACK_SER_12(x, ...)					MSGPACK_SER(x) MSGPACK_SER_11(__VA_ARGS__)
-#define MSGPACK_SER_13(x, ...)					MSGPACK_SER(x) MSGPACK_SER_12(__VA_ARGS__)
-#define MSGPACK_SER_14(x, ...)					MSGPACK_SER(x) MSGPACK_SER_13(__VA_ARGS__)
-#define MSGPACK_SER_15(x, ...)					MSGPACK_SER(x) MSGPACK_SER_14(__VA_ARGS__)
-#define MSGPACK_SER_16(x, ...)					MSGPACK_SER(x) MSGPACK_SER_15(__VA_ARGS__)
-#define MSGPACK_SER_17(x, ...)					MSGPACK_SER(x) MSGPACK_SER_16(__VA_ARGS__)
-#define MSGPACK_SER_18(x, ...)					MSGPACK_SER(x) MSGPACK_SER_17(__VA_ARGS__)
-#define MSGPACK_SER_19(x, ...)					MSGPACK_SER(x) MSGPACK_SER_18(__VA_ARGS__)
-#define MSGPACK_SER_20(x, ...)					MSGPACK_SER(x) MSGPACK_SER_19(__VA_ARGS__)
-#define MSGPACK_SER_21(x, ...)					MSGPACK_SER(x) MSGPACK_SER_20(__VA_ARGS__)
-#define MSGPACK_SER_22(x, ...)					MSGPACK_SER(x) MSGPACK_SER_21(__VA_ARGS__)
-#define MSGPACK_SER_23(x, ...)					MSGPACK_SER(x) MSGPACK_SER_22(__VA_ARGS__)
-#define MSGPACK_SER_24(x, ...)					MSGPACK_SER(x) MSGPACK_SER_23(__VA_ARGS__)
-#define MSGPACK_SER_25(x, ...)					MSGPACK_SER(x) MSGPACK_SER_24(__VA_ARGS__)
-#define MSGPACK_SER_26(x, ...)					MSGPACK_SER(x) MSGPACK_SER_25(__VA_ARGS__)
-#define MSGPACK_SER_27(x, ...)					MSGPACK_SER(x) MSGPACK_SER_26(__VA_ARGS__)
-#define MSGPACK_SER_28(x, ...)					MSGPACK_SER(x) MSGPACK_SER_27(__VA_ARGS__)
-#define MSGPACK_SER_29(x, ...)					MSGPACK_SER(x) MSGPACK_SER_28(__VA_ARGS__)
-#define MSGPACK_SER_30(x, ...)					MSGPACK_SER(x) MSGPACK_SER_29(__VA_ARGS__)
-#define MSGPACK_SER_31(x, ...)					MSGPACK_SER(x) MSGPACK_SER_30(__VA_ARGS__)
-#define MSGPACK_SER_32(x, ...)					MSGPACK_SER(x) MSGPACK_SER_31(__VA_ARGS__)
-#define MSGPACK_SER_33(x, ...)					MSGPACK_SER(x) MSGPACK_SER_32(__VA_ARGS__)
-#define MSGPACK_SER_34(x, ...)					MSGPACK_SER(x) MSGPACK_SER_33(__VA_ARGS__)
-#define MSGPACK_SER_35(x, ...)					MSGPACK_SER(x) MSGPACK_SER_34(__VA_ARGS__)
-#define MSGPACK_SER_36(x, ...)					MSGPACK_SER(x) MSGPACK_SER_35(__VA_ARGS__)
-#define MSGPACK_SER_37(x, ...)					MSGPACK_SER(x) MSGPACK_SER_36(__VA_ARGS__)
-#define MSGPACK_SER_38(x, ...)					MSGPACK_SER(x) MSGPACK_SER_37(__VA_ARGS__)
-#define MSGPACK_SER_39(x, ...)					MSGPACK_SER(x) MSGPACK_SER_38(__VA_ARGS__)
-#define MSGPACK_SER_40(x, ...)					MSGPACK_SER(x) MSGPACK_SER_39(__VA_ARGS__)
-#define MSGPACK_SER_41(x, ...)					MSGPACK_SER(x) MSGPACK_SER_40(__VA_ARGS__)
-#define MSGPACK_SER_42(x, ...)					MSGPACK_SER(x) MSGPACK_SER_41(__VA_ARGS__)
-#define MSGPACK_SER_43(x, ...)					MSGPACK_SER(x) MSGPACK_SER_42(__VA_ARGS__)
-#define MSGPACK_SER_44(x, ...)					MSGPACK_SER(x) MSGPACK_SER_43(__VA_ARGS__)
-#define MSGPACK_SER_45(x, ...)					MSGPACK_SER(x) MSGPACK_SER_44(__VA_ARGS__)
-#define MSGPACK_SER_46(x, ...)					MSGPACK_SER(x) MSGPACK_SER_45(__VA_ARGS__)
-#define MSGPACK_SER_47(x, ...)					MSGPACK_SER(x) MSGPACK_SER_46(__VA_ARGS__)
-#define MSGPACK_SER_48(x, ...)					MSGPACK_SER(x) MSGPACK_SER_47(__VA_ARGS__)
-#define MSGPACK_SER_49(x, ...)					MSGPACK_SER(x) MSGPACK_SER_48(__VA_ARGS__)
-#define MSGPACK_SER_50(x, ...)					MSGPACK_SER(x) MSGPACK_SER_49(__VA_ARGS__)
-
-#define MSGPACK_DES(x)									mapDeserializer.addMember((std::string(key) + '"' + #x + '"').c_str(), &x);
-#define MSGPACK_DES_1(x)								MSGPACK_DES(x)
-#define MSGPACK_DES_2(x, ...)						MSGPACK_DES(x) MSGPACK_DES_1 (__VA_ARGS__)
-#define MSGPACK_DES_3(x, ...)						MSGPACK_DES(x) MSGPACK_DES_2 (__VA_ARGS__)
-#define MSGPACK_DES_4(x, ...)						MSGPACK_DES(x) MSGPACK_DES_3 (__VA_ARGS__)
-#define MSGPACK_DES_5(x, ...)						MSGPACK_DES(x) MSGPACK_DES_4 (__VA_ARGS__)
-#define MSGPACK_DES_6(x, ...)						MSGPACK_DES(x) MSGPACK_DES_5 (__VA_ARGS__)
-#define MSGPACK_DES_7(x, ...)						MSGPACK_DES(x) MSGPACK_DES_6 (__VA_ARGS__)
-#define MSGPACK_DES_8(x, ...)						MSGPACK_DES(x) MSGPACK_DES_7 (__VA_ARGS__)
-#define MSGPACK_DES_9(x, ...)						MSGPACK_DES(x) MSGPACK_DES_8 (__VA_ARGS__)
-#define MSGPACK_DES_10(x, ...)					MSGPACK_DES(x) MSGPACK_DES_9 (__VA_ARGS__)
-#define MSGPACK_DES_11(x, ...)					MSGPACK_DES(x) MSGPACK_DES_10(__VA_ARGS__)
-#define MSGPACK_DES_12(x, ...)					MSGPACK_DES(x) MSGPACK_DES_11(__VA_ARGS__)
-#define MSGPACK_DES_13(x, ...)					MSGPACK_DES(x) MSGPACK_DES_12(__VA_ARGS__)
-#define MSGPACK_DES_14(x, ...)					MSGPACK_DES(x) MSGPACK_DES_13(__VA_ARGS__)
-#define MSGPACK_DES_15(x, ...)					MSGPACK_DES(x) MSGPACK_DES_14(__VA_ARGS__)
-#define MSGPACK_DES_16(x, ...)					MSGPACK_DES(x) MSGPACK_DES_15(__VA_ARGS__)
-#define MSGPACK_DES_17(x, ...)					MSGPACK_DES(x) MSGPACK_DES_16(__VA_ARGS__)
-#define MSGPACK_DES_18(x, ...)					MSGPACK_DES(x) MSGPACK_DES_17(__VA_ARGS__)
-#define MSGPACK_DES_19(x, ...)					MSGPACK_DES(x) MSGPACK_DES_18(__VA_ARGS__)
-#define MSGPACK_DES_20(x, ...)					MSGPACK_DES(x) MSGPACK_DES_19(__VA_ARGS__)
-#define MSGPACK_DES_21(x, ...)					MSGPACK_DES(x) MSGPACK_DES_20(__VA_ARGS__)
-#define MSGPACK_DES_22(x, ...)					MSGPACK_DES(x) MSGPACK_DES_21(__VA_ARGS__)
-#define MSGPACK_DES_23(x, ...)					MSGPACK_DES(x) MSGPACK_DES_22(__VA_ARGS__)
-#define MSGPACK_DES_24(x, ...)					MSGPACK_DES(x) MSGPACK_DES_23(__VA_ARGS__)
-#define MSGPACK_DES_25(x, ...)					MSGPACK_DES(x) MSGPACK_DES_24(__VA_ARGS__)
-#define MSGPACK_DES_26(x, ...)					MSGPACK_DES(x) MSGPACK_DES_25(__VA_ARGS__)
-#define MSGPACK_DES_27(x, ...)					MSGPACK_DES(x) MSGPACK_DES_26(__VA_ARGS__)
-#define MSGPACK_DES_28(x, ...)					MSGPACK_DES(x) MSGPACK_DES_27(__VA_ARGS__)
-#define MSGPACK_DES_29(x, ...)					MSGPACK_DES(x) MSGPACK_DES_28(__VA_ARGS__)
-#define MSGPACK_DES_30(x, ...)					MSGPACK_DES(x) MSGPACK_DES_29(__VA_ARGS__)
-#define MSGPACK_DES_31(x, ...)					MSGPACK_DES(x) MSGPACK_DES_30(__VA_ARGS__)
-#define MSGPACK_DES_32(x, ...)					MSGPACK_DES(x) MSGPACK_DES_31(__VA_ARGS__)
-#define MSGPACK_DES_33(x, ...)					MSGPACK_DES(x) MSGPACK_DES_32(__VA_ARGS__)
-#define MSGPACK_DES_34(x, ...)					MSGPACK_DES(x) MSGPACK_DES_33(__VA_ARGS__)
-#define MSGPACK_DES_35(x, ...)					MSGPACK_DES(x) MSGPACK_DES_34(__VA_ARGS__)
-#define MSGPACK_DES_36(x, ...)					MSGPACK_DES(x) MSGPACK_DES_35(__VA_ARGS__)
-#define MSGPACK_DES_37(x, ...)					MSGPACK_DES(x) MSGPACK_DES_36(__VA_ARGS__)
-#define MSGPACK_DES_38(x, ...)					MSGPACK_DES(x) MSGPACK_DES_37(__VA_ARGS__)
-#define MSGPACK_DES_39(x, ...)					MSGPACK_DES(x) MSGPACK_DES_38(__VA_ARGS__)
-#define MSGPACK_DES_40(x, ...)					MSGPACK_DES(x) MSGPACK_DES_39(__VA_ARGS__)
-#define MSGPACK_DES_41(x, ...)					MSGPACK_DES(x) MSGPACK_DES_40(__VA_ARGS__)
-#define MSGPACK_DES_42(x, ...)					MSGPACK_DES(x) MSGPACK_DES_41(__VA_ARGS__)
-#define MSGPACK_DES_43(x, ...)					MSGPACK_DES(x) MSGPACK_DES_42(__VA_ARGS__)
-#define MSGPACK_DES_44(x, ...)					MSGPACK_DES(x) MSGPACK_DES_43(__VA_ARGS__)
-#define MSGPACK_DES_45(x, ...)					MSGPACK_DES(x) MSGPACK_DES_44(__VA_ARGS__)
-#define MSGPACK_DES_46(x, ...)					MSGPACK_DES(x) MSGPACK_DES_45(__VA_ARGS__)
-#define MSGPACK_DES_47(x, ...)					MSGPACK_DES(x) MSGPACK_DES_46(__VA_ARGS__)
-#define MSGPACK_DES_48(x, ...)					MSGPACK_DES(x) MSGPACK_DES_47(__VA_ARGS__)
-#define MSGPACK_DES_49(x, ...)					MSGPACK_DES(x) MSGPACK_DES_48(__VA_ARGS__)
-#define MSGPACK_DES_50(x, ...)					MSGPACK_DES(x) MSGPACK_DES_49(__VA_ARGS__)
+template <class F> \
+void msgpackFields(F&& msgpackVisitor) { \
+	msgpackVisitor(__VA_ARGS__); \
+} \
+template <class F> \
+void msgpackFields(F&& msgpackVisitor) const { \
+	msgpackVisitor(__VA_ARGS__); \
+}
 
 #endif
@@ -27,7 +27,7 @@ struct ObjectA {
 	CA_MSGPACK(integer, boolean, string, objectB, stringArray, stringMap, objectBArray, objectBMap);
 };
 
-int main(int argc, const char * argv[]) {
+int main() {
 	std::stringbuf inBuf;
 
 	{
@@ -36,7 +36,7 @@ int main(int argc, const char * argv[]) {
 			12,
 			true,
 			"foo",
-			{ 52, "bar" },
+			ObjectB{ 52, "bar" },
 			std::vector<std::string>{ "baz1", "baz2", "baz3" },
 			std::map<std::string, std::string>{ { "key1", "value1" }, { "key2", "value2" } },
 			std::vector<ObjectB>{ { 111, "xxx" }, { 222, "yyy" } },
@@ -0,0 +1,825 @@
+/*
+ * tests.cpp
+ * msgpack_test
+ *
+ * Checks for the paths that take untrusted input: validate(), Unpacker and the
+ * streambuf reader, plus round trips for the member types, unpack options,
+ * encodings and containers, and a Batch round trip against serial pack().
+ * Returns non-zero if any check fails.
+ */
+
+#include "ca_msgpack.h"
+#include <cstdio>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while (0)
+
+struct ObjectB {
+	int integer;
+	std::string string;
+	CA_MSGPACK(integer, string);
+};
+
+struct ObjectA {
+	int integer;
+	std::vector<ObjectB> objectBArray;
+	std::map<std::string, ObjectB> objectBMap;
+	CA_MSGPACK(integer, objectBArray, objectBMap);
+};
+
+struct Timestamp {
+	std::chrono::system_clock::time_point time;
+	CA_MSGPACK(time);
+};
+
+struct Seconds {
+	std::chrono::time_point<std::chrono::system_clock, std::chrono::seconds> time;
+	CA_MSGPACK(time);
+};
+
+#ifdef CA_MSGPACK_PMR
+struct PmrObjectB {
+	int integer;
+	std::pmr::string string;
+	CA_MSGPACK(integer, string);
+};
+
+struct PmrObjectA {
+	int integer;
+	std::pmr::vector<PmrObjectB> objectBArray;
+	std::pmr::map<std::pmr::string, PmrObjectB> objectBMap;
+	CA_MSGPACK(integer, objectBArray, objectBMap);
+};
+#endif
+
+// the member types added next to the original ones
+struct Members {
+	int8_t i8;
+	uint8_t u8;
+	int16_t i16;
+	uint16_t u16;
+	std::vector<uint8_t> bin;
+	std::array<int32_t, 3> triple;
+	std::unordered_map<int32_t, std::string> names;
+#ifdef CA_MSGPACK_CXX17
+	std::optional<ObjectB> present;
+	std::optional<int32_t> absent;
+	CA_MSGPACK(i8, u8, i16, u16, bin, triple, names, present, absent);
+#else
+	CA_MSGPACK(i8, u8, i16, u16, bin, triple, names);
+#endif
+};
+
+// borrows from the unpacked buffer
+struct Borrowed {
+	ca_msgpack::BytesView bytes;
+#ifdef CA_MSGPACK_CXX17
+	std::string_view string;
+	CA_MSGPACK(bytes, string);
+#else
+	CA_MSGPACK(bytes);
+#endif
+};
+
+// more fields than the old fixed-arity macros took
+struct Wide {
+	int32_t f00, f01, f02, f03, f04, f05, f06, f07, f08, f09, f10, f11, f12, f13, f14, f15;
+	int32_t f16, f17, f18, f19, f20, f21, f22, f23, f24, f25, f26, f27, f28, f29, f30, f31;
+	int32_t f32, f33, f34, f35, f36, f37, f38, f39, f40, f41, f42, f43, f44, f45, f46, f47;
+	int32_t f48, f49, f50, f51, f52, f53, f54, f55, f56, f57, f58, f59, f60, f61, f62, f63;
+	CA_MSGPACK(f00, f01, f02, f03, f04, f05, f06, f07, f08, f09, f10, f11, f12, f13, f14, f15,
+		f16, f17, f18, f19, f20, f21, f22, f23, f24, f25, f26, f27, f28, f29, f30, f31,
+		f32, f33, f34, f35, f36, f37, f38, f39, f40, f41, f42, f43, f44, f45, f46, f47,
+		f48, f49, f50, f51, f52, f53, f54, f55, f56, f57, f58, f59, f60, f61, f62, f63);
+};
+
+// packs a map header and a key, then throws when asked to
+struct Failing {
+	bool fail;
+	ObjectB objectB;
+	void pack(ca_msgpack::Writer& writer) const {
+		if (fail) {
+			writer.writeMapHeader(2);
+			writer.writeString("integer", 7);
+			throw ca_msgpack::MsgPackError();
+		}
+		objectB.pack(writer);
+	}
+};
+
+static ObjectA sample(int integer) {
+	ObjectA a;
+	a.integer = integer;
+	a.objectBArray.push_back(ObjectB{ 111, "xxx" });
+	a.objectBArray.push_back(ObjectB{ 222, "h\xc3\xa9llo \xe2\x82\xac \xf0\x9f\x98\x80" });
+	a.objectBMap["key"] = ObjectB{ 333, std::string(100, 'z') };
+	return a;
+}
+
+static std::string packed(const ObjectA& a) {
+	std::string buffer;
+	ca_msgpack::Writer writer(buffer);
+	a.pack(writer);
+	writer.flush();
+	return buffer;
+}
+
+// packs obj and unpacks it into out; false if either side throws
+template <class T>
+static bool roundTrip(const T& obj, T& out) {
+	std::string buffer;
+	try {
+		ca_msgpack::Writer writer(buffer);
+		obj.pack(writer);
+		writer.flush();
+		out.unpack(buffer.data(), buffer.size());
+		return true;
+	} catch (ca_msgpack::MsgPackError&) {
+		return false;
+	}
+}
+
+static bool valid(const std::string& data, const ca_msgpack::Limits& limits = ca_msgpack::Limits()) {
+	return ca_msgpack::validate(data.data(), data.size(), limits) == data.size();
+}
+
+static bool unpacks(const std::string& data) {
+	ObjectA a;
+	try {
+		a.unpack(data.data(), data.size());
+		return true;
+	} catch (ca_msgpack::MsgPackError&) {
+		return false;
+	}
+}
+
+static std::string str(const char* bytes) {
+	std::string buffer;
+	ca_msgpack::Writer writer(buffer);
+	writer.writeString(bytes, strlen(bytes));
+	writer.flush();
+	return buffer;
+}
+
+static void testMalformed() {
+	std::string message = packed(sample(1));
+	CHECK(valid(message));
+	CHECK(unpacks(message));
+	// a trailing object is not part of the message
+	CHECK(ca_msgpack::validate((message + "\xc0").data(), message.size() + 1) == message.size());
+	// every truncation is rejected
+	for (size_t size = 0; size < message.size(); size++) {
+		std::string truncated = message.substr(0, size);
+		CHECK(ca_msgpack::validate(truncated.data(), truncated.size()) == 0);
+		CHECK(!unpacks(truncated));
+	}
+	CHECK(!valid(std::string("\xc1", 1)));
+	CHECK(!unpacks(std::string("\xc1", 1)));
+	// headers announcing more than the buffer holds
+	std::string elements("\xdd\xff\xff\xff\xff", 5);
+	std::string payload("\xdb\xff\xff\xff\xff", 5);
+	CHECK(!valid(elements));
+	CHECK(!valid(payload));
+	ca_msgpack::Reader reader(elements.data(), elements.size());
+	bool thrown = false;
+	try { reader.skip(); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+	CHECK(thrown);
+	// a validated unpack leaves the target untouched
+	std::string corrupt = message;
+	corrupt[corrupt.size() - 1] = (char)0xc1;
+	ca_msgpack::Limits limits;
+	ca_msgpack::UnpackOptions options;
+	options.limits = &limits;
+	ObjectA target;
+	target.integer = 77;
+	thrown = false;
+	try { target.unpack(corrupt.data(), corrupt.size(), options); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+	CHECK(thrown && target.integer == 77 && target.objectBArray.empty());
+}
+
+static void testUtf8() {
+	CHECK(valid(str("h\xc3\xa9llo \xe2\x82\xac \xf0\x9f\x98\x80")));
+	CHECK(valid(str(std::string(100, 'a').c_str())));
+	const char* invalid[] = {
+		"\xc0\x80",         // overlong NUL
+		"\xe0\x80\x80",     // overlong 3 bytes
+		"\xf0\x80\x80\x80", // overlong 4 bytes
+		"\xed\xa0\x80",     // surrogate
+		"\xed\xbf\xbf",     // surrogate
+		"\xf4\x90\x80\x80", // above U+10FFFF
+		"\xf5\x80\x80\x80",
+		"\xc3",             // truncated
+		"\xe2\x82",
+		"\x80",             // stray continuation
+	};
+	for (const char* bytes : invalid) {
+		CHECK(!valid(str(bytes)));
+		// after a long ASCII run, where the block scan hands over
+		CHECK(!valid(str((std::string(37, 'a') + bytes).c_str())));
+	}
+	ca_msgpack::Limits limits;
+	limits.utf8 = false;
+	CHECK(valid(str("\xed\xa0\x80"), limits));
+}
+
+static void testLimits() {
+	std::string deep;
+	for (int i = 0; i < 100; i++) {
+		deep += "\x91";
+	}
+	deep += "\x01";
+	ca_msgpack::Limits limits;
+	CHECK(!valid(deep, limits));
+	limits.depth = 100;
+	CHECK(valid(deep, limits));
+	limits.depth = 99;
+	CHECK(!valid(deep, limits));
+	// capped at MaxDepth
+	std::string deeper(ca_msgpack::Limits::MaxDepth + 1, '\x91');
+	deeper += "\x01";
+	limits.depth = 100000;
+	CHECK(!valid(deeper, limits));
+
+	std::string message = packed(sample(1));
+	ca_msgpack::Limits elements;
+	elements.elements = 1;
+	CHECK(!valid(message, elements));
+	ca_msgpack::Limits length;
+	length.length = 50;
+	CHECK(!valid(message, length));
+}
+
+static void testUnpacker() {
+	std::string stream;
+	for (int i = 0; i < 50; i++) {
+		stream += packed(sample(i));
+	}
+	// every chunk size, including one byte at a time
+	for (size_t chunk = 1; chunk <= 64; chunk++) {
+		ca_msgpack::Unpacker unpacker;
+		int count = 0;
+		bool ordered = true;
+		for (size_t offset = 0; offset < stream.size(); offset += chunk) {
+			unpacker.feed(stream.data() + offset, std::min(chunk, stream.size() - offset));
+			while (unpacker.next() == ca_msgpack::Unpacker::Complete) {
+				ObjectA a;
+				unpacker.unpack(a);
+				ordered = ordered && a.integer == count && a.objectBMap["key"].integer == 333;
+				count++;
+			}
+		}
+		CHECK(ordered && count == 50);
+		CHECK(unpacker.buffered() == 0);
+	}
+	ca_msgpack::Unpacker invalid;
+	invalid.feed("\x92\x01\xc1", 3);
+	CHECK(invalid.next() == ca_msgpack::Unpacker::Error);
+	ca_msgpack::Unpacker bounded(1024);
+	bounded.feed("\xdb\x00\x01\x00\x00", 5);
+	CHECK(bounded.next() == ca_msgpack::Unpacker::Error);
+}
+
+static void testStreambuf() {
+	std::string message = packed(sample(5));
+	std::stringbuf sb(message + message);
+	ObjectA a;
+	a.unpack(&sb);
+	CHECK(a.integer == 5 && a.objectBArray.size() == 2);
+	a.unpack(&sb);
+	CHECK(a.integer == 5);
+	// a str32 announcing 3.5 GB is refused after the bytes that are there
+	std::string hostile("\x81\xa7integer\xdb\xd3\x00\x00\x00", 14);
+	hostile += std::string(100, 'x');
+	std::stringbuf hostileSb(hostile);
+	ObjectB b;
+	bool thrown = false;
+	try { b.unpack(&hostileSb); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+	CHECK(thrown);
+}
+
+static void testMembers() {
+	Members in;
+	in.i8 = -128;
+	in.u8 = 255;
+	in.i16 = -32768;
+	in.u16 = 65535;
+	for (int i = 0; i < 300; i++) {
+		in.bin.push_back((uint8_t)i);
+	}
+	in.triple[0] = -1;
+	in.triple[1] = 0;
+	in.triple[2] = 1 << 30;
+	in.names[1] = "one";
+	in.names[-2] = "minus two";
+#ifdef CA_MSGPACK_CXX17
+	in.present = ObjectB{ 3, "three" };
+#endif
+	Members out;
+#ifdef CA_MSGPACK_CXX17
+	out.absent = 5;
+#endif
+	CHECK(roundTrip(in, out));
+	CHECK(out.i8 == -128 && out.u8 == 255 && out.i16 == -32768 && out.u16 == 65535);
+	CHECK(out.bin == in.bin && out.triple == in.triple && out.names == in.names);
+#ifdef CA_MSGPACK_CXX17
+	CHECK(out.present && out.present->integer == 3 && out.present->string == "three");
+	// nil empties an optional that held a value
+	CHECK(!out.absent);
+#endif
+	// bytes are bin 16 here, not an array of integers
+	std::string buffer;
+	{
+		ca_msgpack::Writer writer(buffer);
+		in.pack(writer);
+	}
+	std::string bin16("\xa3" "bin" "\xc5\x01\x2c", 7);
+	CHECK(buffer.find(bin16) != std::string::npos);
+	// std::array takes exactly N elements
+	std::string shorter;
+	{
+		ca_msgpack::Writer writer(shorter);
+		ca_msgpack::MapSerializer serializer(writer);
+		writer.writeMapHeader(1);
+		serializer.serialize("triple", 6, std::vector<int32_t>{ 1, 2 });
+	}
+	bool thrown = false;
+	try { out.unpack(shorter.data(), shorter.size()); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+	CHECK(thrown);
+}
+
+static void testBorrowed() {
+	static const char bytes[] = { 0, 1, (char)0xff, 0x7f };
+	Borrowed in;
+	in.bytes = ca_msgpack::BytesView(bytes, sizeof(bytes));
+#ifdef CA_MSGPACK_CXX17
+	in.string = std::string_view("borrowed");
+#endif
+	std::string buffer;
+	{
+		ca_msgpack::Writer writer(buffer);
+		in.pack(writer);
+	}
+	Borrowed out;
+	out.unpack(buffer.data(), buffer.size());
+	const char* end = buffer.data() + buffer.size();
+	CHECK(out.bytes.size() == sizeof(bytes) && memcmp(out.bytes.data(), bytes, sizeof(bytes)) == 0);
+	CHECK(out.bytes.begin() > buffer.data() && out.bytes.end() <= end);
+#ifdef CA_MSGPACK_CXX17
+	CHECK(out.string == "borrowed");
+	CHECK(out.string.data() > buffer.data() && out.string.data() + out.string.size() <= end);
+#endif
+	// a streambuf has no buffer that outlives the call to borrow from
+	std::stringbuf sb(buffer);
+	bool thrown = false;
+	try { out.unpack(&sb); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+	CHECK(thrown);
+}
+
+#ifdef CA_MSGPACK_PMR
+static void testPmr() {
+	std::string message = packed(sample(7));
+	// a fixed buffer with no upstream: anything that escapes the arena throws bad_alloc
+	static char storage[1 << 16];
+	std::pmr::monotonic_buffer_resource arena(storage, sizeof(storage), std::pmr::null_memory_resource());
+	PmrObjectA a;
+	a.unpack(message.data(), message.size(), &arena);
+	const PmrObjectB& b = a.objectBMap.at("key");
+	CHECK(a.objectBArray.get_allocator().resource() == &arena);
+	CHECK(a.objectBMap.get_allocator().resource() == &arena);
+	CHECK(a.objectBArray[1].string.get_allocator().resource() == &arena);
+	CHECK(b.string.size() == 100 && b.string.data() >= storage && b.string.data() + 100 <= storage + sizeof(storage));
+	std::string repacked;
+	{
+		ca_msgpack::Writer writer(repacked);
+		a.pack(writer);
+	}
+	CHECK(repacked == message);
+	// without a resource the members stay on the default one
+	PmrObjectA d;
+	d.unpack(message.data(), message.size());
+	CHECK(d.objectBArray.get_allocator().resource() == std::pmr::get_default_resource());
+}
+#endif
+
+static void testSkipUnknown() {
+	// ObjectA from a newer producer: an unknown top-level key with a nested value,
+	// and an unknown key inside an ObjectB
+	std::string message;
+	{
+		ca_msgpack::Writer writer(message);
+		writer.writeMapHeader(4);
+		writer.writeString("integer", 7);
+		writer.writeInt(9);
+		writer.writeString("added", 5);
+		writer.writeMapHeader(1);
+		writer.writeString("list", 4);
+		writer.writeArrayHeader(3);
+		writer.writeInt(1);
+		writer.writeString("two", 3);
+		writer.writeDouble(3.0);
+		writer.writeString("objectBArray", 12);
+		writer.writeArrayHeader(1);
+		writer.writeMapHeader(3);
+		writer.writeString("integer", 7);
+		writer.writeInt(111);
+		writer.writeString("flag", 4);
+		writer.writeBool(true);
+		writer.writeString("string", 6);
+		writer.writeString("xxx", 3);
+		writer.writeString("objectBMap", 10);
+		writer.writeMapHeader(0);
+	}
+	CHECK(!unpacks(message));
+	size_t skipped = 100;
+	ca_msgpack::UnpackOptions options;
+	options.skipUnknown = true;
+	options.skipped = &skipped;
+	ObjectA a;
+	a.unpack(message.data(), message.size(), options);
+	CHECK(skipped == 2);
+	CHECK(a.integer == 9 && a.objectBArray.size() == 1 && a.objectBArray[0].integer == 111 &&
+		a.objectBArray[0].string == "xxx" && a.objectBMap.empty());
+	// the count is per message
+	std::string known = packed(sample(3));
+	a.unpack(known.data(), known.size(), options);
+	CHECK(skipped == 0);
+}
+
+static void testPositional() {
+	ObjectA in = sample(8);
+	std::string positional;
+	{
+		ca_msgpack::Writer writer(positional);
+		writer.setPositional(true);
+		in.pack(writer);
+	}
+	CHECK((unsigned char)positional[0] == 0x93);
+	CHECK(positional.size() < packed(in).size());
+	ObjectA out;
+	out.unpack(positional.data(), positional.size());
+	CHECK(packed(out) == packed(in));
+	// a newer producer with a third ObjectB field
+	std::string extra;
+	{
+		ca_msgpack::Writer writer(extra);
+		writer.writeArrayHeader(3);
+		writer.writeInt(4);
+		writer.writeString("four", 4);
+		writer.writeArrayHeader(0);
+	}
+	ObjectB b;
+	bool thrown = false;
+	try { b.unpack(extra.data(), extra.size()); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+	CHECK(thrown);
+	size_t skipped = 0;
+	ca_msgpack::UnpackOptions options;
+	options.skipUnknown = true;
+	options.skipped = &skipped;
+	b.unpack(extra.data(), extra.size(), options);
+	CHECK(b.integer == 4 && b.string == "four" && skipped == 1);
+	// an older producer without the trailing string: the field is left as it was
+	std::string missing;
+	{
+		ca_msgpack::Writer writer(missing);
+		writer.writeArrayHeader(1);
+		writer.writeInt(5);
+	}
+	b.unpack(missing.data(), missing.size());
+	CHECK(b.integer == 5 && b.string == "four");
+}
+
+static void testWide() {
+	CHECK(Wide::msgpackNames().size() == 64);
+	// keys last to first resolve through the hash
+	std::string reversed;
+	{
+		ca_msgpack::Writer writer(reversed);
+		ca_msgpack::MapSerializer serializer(writer);
+		writer.writeMapHeader(64);
+		for (int i = 63; i >= 0; i--) {
+			char key[4];
+			snprintf(key, sizeof(key), "f%02d", i);
+			serializer.serialize(key, 3, i * 3 + 1);
+		}
+	}
+	Wide in;
+	in.unpack(reversed.data(), reversed.size());
+	CHECK(in.f00 == 1 && in.f31 == 94 && in.f63 == 190);
+	Wide out;
+	CHECK(roundTrip(in, out));
+	CHECK(out.f00 == 1 && out.f17 == 52 && out.f50 == 151 && out.f63 == 190);
+}
+
+#ifdef CA_MSGPACK_MMAP
+// a temporary file holding data; path receives its name
+static bool temporaryFile(char* path, const std::string& data) {
+	strcpy(path, "/tmp/ca_msgpack_tests_XXXXXX");
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		return false;
+	}
+	bool written = write(fd, data.data(), data.size()) == (ssize_t)data.size();
+	close(fd);
+	return written;
+}
+
+static void testMappedFile() {
+	std::string records;
+	for (int i = 0; i < 100; i++) {
+		records += packed(sample(i));
+	}
+	char path[64];
+	char indexPath[64];
+	char otherPath[64];
+	CHECK(temporaryFile(path, records));
+	CHECK(temporaryFile(indexPath, ""));
+	// the same records with the last one cut short
+	CHECK(temporaryFile(otherPath, records.substr(0, records.size() - 10)));
+	{
+		ca_msgpack::MappedFile file(path);
+		CHECK(file.size() == records.size() && file.count() == 0);
+		file.buildIndex();
+		CHECK(file.count() == 100);
+		ObjectA a;
+		file.read(37, a);
+		CHECK(a.integer == 37 && packed(a) == packed(sample(37)));
+		bool thrown = false;
+		try { file.read(100, a); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+		CHECK(thrown);
+		file.saveIndex(indexPath);
+
+		std::vector<ca_msgpack::MappedFile::Range> ranges = file.split(4);
+		CHECK(ranges.size() == 4);
+		bool contiguous = ranges.front().first == 0 && ranges.back().last == 100;
+		for (size_t i = 0; i < ranges.size(); i++) {
+			contiguous = contiguous && ranges[i].first < ranges[i].last && (i == 0 || ranges[i].first == ranges[i - 1].last);
+		}
+		CHECK(contiguous);
+		ranges = file.split(1000);
+		CHECK(ranges.size() == 100 && ranges.back().last == 100);
+	}
+	{
+		ca_msgpack::MappedFile file(path);
+		CHECK(file.loadIndex(indexPath));
+		CHECK(file.count() == 100 && file.recordSize(99) == packed(sample(99)).size());
+		CHECK(file.record(99) + file.recordSize(99) == file.data() + file.size());
+		CHECK(!file.loadIndex("/nonexistent/ca_msgpack.index"));
+	}
+	{
+		ca_msgpack::MappedFile other(otherPath);
+		bool thrown = false;
+		try { other.buildIndex(); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+		CHECK(thrown && other.count() == 0);
+		// the index was built for a file of another size
+		CHECK(!other.loadIndex(indexPath));
+		CHECK(other.count() == 0);
+	}
+	unlink(path);
+	unlink(indexPath);
+	unlink(otherPath);
+}
+#endif
+
+static void testView() {
+	ObjectA in = sample(6);
+	std::string positional;
+	{
+		ca_msgpack::Writer writer(positional);
+		writer.setPositional(true);
+		in.pack(writer);
+	}
+	const std::string messages[] = { packed(in), positional };
+	for (const std::string& message : messages) {
+		ca_msgpack::View<ObjectA> view(message.data(), message.size());
+		int integer = 0;
+		CHECK(view.get(&ObjectA::integer, integer) && integer == 6);
+		CHECK(view.has(&ObjectA::objectBMap) && view.size(&ObjectA::objectBArray) == 2);
+		ObjectB b;
+		CHECK(view.at(&ObjectA::objectBArray, 1, b) && b.integer == 222 && b.string == in.objectBArray[1].string);
+		CHECK(!view.at(&ObjectA::objectBArray, 2, b));
+		// nested object as a view of its own, decoding one field of it
+		ca_msgpack::View<ObjectB> nested;
+		CHECK(view.find(&ObjectA::objectBMap, "key", 3, nested));
+		std::string string;
+		CHECK(nested.get(&ObjectB::string, string) && string == std::string(100, 'z'));
+		CHECK(!view.find(&ObjectA::objectBMap, std::string("other"), nested));
+		ca_msgpack::View<ObjectB> element;
+		CHECK(view.at(&ObjectA::objectBArray, 0, element) && element.get(&ObjectB::integer, integer) && integer == 111);
+		ca_msgpack::View<ObjectA> copy(view);
+		CHECK(copy.get(&ObjectA::integer, integer) && integer == 6);
+	}
+	// fields the message does not have
+	std::string partial;
+	{
+		ca_msgpack::Writer writer(partial);
+		ca_msgpack::MapSerializer serializer(writer);
+		writer.writeMapHeader(1);
+		serializer.serialize("integer", 7, 4);
+	}
+	ca_msgpack::View<ObjectA> view(partial.data(), partial.size());
+	std::vector<ObjectB> array;
+	CHECK(!view.has(&ObjectA::objectBArray) && !view.get(&ObjectA::objectBArray, array));
+	CHECK(view.size(&ObjectA::objectBMap) == 0);
+	// more fields than the inline offset table holds
+	Wide wide = Wide();
+	wide.f40 = 40;
+	wide.f63 = 63;
+	std::string wideMessage;
+	{
+		ca_msgpack::Writer writer(wideMessage);
+		wide.pack(writer);
+	}
+	ca_msgpack::View<Wide> wideView(wideMessage.data(), wideMessage.size());
+	int32_t value = 0;
+	CHECK(wideView.get(&Wide::f63, value) && value == 63);
+	CHECK(wideView.get(&Wide::f40, value) && value == 40);
+}
+
+static void testTimestamp() {
+	std::string message;
+	{
+		ca_msgpack::Writer writer(message);
+		writer.writeMapHeader(1);
+		writer.writeString("time", 4);
+		// valid, but beyond the range of system_clock::time_point
+		writer.writeTimestamp(INT64_MAX / 2, 0);
+	}
+	Timestamp t;
+	bool thrown = false;
+	try { t.unpack(message.data(), message.size()); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+	CHECK(thrown);
+
+	// the ends of the range, e.g. as "never expires" sentinels, and either side of the epoch
+	typedef std::chrono::system_clock::time_point TimePoint;
+	typedef std::chrono::system_clock::duration Duration;
+	const TimePoint points[] = { TimePoint::min(), TimePoint::max(), TimePoint(Duration(-1)), TimePoint(Duration(1)), TimePoint() };
+	for (const TimePoint& point : points) {
+		Timestamp in, out;
+		in.time = point;
+		CHECK(roundTrip(in, out) && out.time == point);
+	}
+	Seconds in, out;
+	in.time = std::chrono::time_point<std::chrono::system_clock, std::chrono::seconds>::max();
+	CHECK(roundTrip(in, out) && out.time == in.time);
+}
+
+static void testStreamWriter() {
+	std::stringbuf log;
+	{
+		ca_msgpack::StreamWriter<Failing> writer(&log);
+		writer.write(Failing{ false, { 1, "a" } });
+		bool thrown = false;
+		try { writer.write(Failing{ true, { 2, "b" } }); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+		CHECK(thrown);
+		writer.write(Failing{ false, { 3, "c" } });
+	}
+	ca_msgpack::StreamReader<ObjectB> reader(&log);
+	ObjectB b;
+	CHECK(reader.read(b) && b.integer == 1);
+	CHECK(reader.read(b) && b.integer == 3);
+	CHECK(!reader.read(b));
+}
+
+static void testBatch() {
+	std::vector<ObjectA> objects;
+	std::string serial;
+	for (int i = 0; i < 1000; i++) {
+		objects.push_back(sample(i));
+		serial += packed(objects.back());
+	}
+	for (size_t threads = 1; threads <= 4; threads++) {
+		ca_msgpack::Batch batch(threads);
+		std::string output;
+		std::vector<uint64_t> offsets;
+		batch.pack(objects.data(), objects.size(), output, offsets);
+		CHECK(output == serial);
+		CHECK(offsets.size() == objects.size() + 1 && offsets.back() == output.size());
+		std::vector<ObjectA> decoded(objects.size());
+		batch.unpack(output.data(), offsets.data(), decoded.data(), decoded.size());
+		bool same = true;
+		for (size_t i = 0; i < decoded.size(); i++) {
+			same = same && packed(decoded[i]) == packed(objects[i]);
+		}
+		CHECK(same);
+	}
+#ifdef CA_MSGPACK_PMR
+	// pmr members land on the arena of the decoding worker, not on the default resource
+	{
+		ca_msgpack::Batch batch(3);
+		batch.setArenas(true);
+		std::string output;
+		std::vector<uint64_t> offsets;
+		batch.pack(objects.data(), objects.size(), output, offsets);
+		for (int round = 0; round < 2; round++) {
+			std::vector<PmrObjectA> decoded(objects.size());
+			batch.unpack(output.data(), offsets.data(), decoded.data(), decoded.size());
+			bool same = true;
+			bool placed = true;
+			for (size_t i = 0; i < decoded.size(); i++) {
+				const PmrObjectA& a = decoded[i];
+				same = same && a.integer == objects[i].integer && a.objectBArray.size() == 2 &&
+					a.objectBArray[1].string == objects[i].objectBArray[1].string.c_str() &&
+					a.objectBMap.at("key").string == objects[i].objectBMap.at("key").string.c_str();
+				placed = placed && a.objectBArray.get_allocator().resource() != std::pmr::get_default_resource() &&
+					a.objectBArray.get_allocator().resource() == a.objectBMap.at("key").string.get_allocator().resource();
+			}
+			CHECK(same);
+			CHECK(placed);
+			decoded.clear();
+			batch.releaseArenas();
+		}
+	}
+#endif
+	// a failing record is rethrown and the next batch is unaffected
+	std::vector<Failing> failing(500, Failing{ false, { 7, "x" } });
+	failing[300].fail = true;
+	ca_msgpack::Batch batch(2);
+	std::string output;
+	std::vector<uint64_t> offsets;
+	bool thrown = false;
+	try { batch.pack(failing.data(), failing.size(), output, offsets); } catch (ca_msgpack::MsgPackError&) { thrown = true; }
+	CHECK(thrown);
+	failing[300].fail = false;
+	batch.pack(failing.data(), failing.size(), output, offsets);
+	CHECK(ca_msgpack::validate(output.data() + offsets[300], (size_t)(offsets[301] - offsets[300])) == offsets[301] - offsets[300]);
+}
+
+// ObjectA's fields in the given key order, with 0 for a key that is not a field
+static std::string reordered(const char* const* keys, size_t count) {
+	ObjectA a = sample(5);
+	std::string buffer;
+	ca_msgpack::Writer writer(buffer);
+	writer.writeMapHeader((uint32_t)count);
+	ca_msgpack::MapSerializer serializer(writer);
+	for (size_t i = 0; i < count; i++) {
+		std::string key = keys[i];
+		if (key == "integer") {
+			serializer.serialize(keys[i], key.size(), a.integer);
+		} else if (key == "objectBArray") {
+			serializer.serialize(keys[i], key.size(), a.objectBArray);
+		} else if (key == "objectBMap") {
+			serializer.serialize(keys[i], key.size(), a.objectBMap);
+		} else {
+			serializer.serialize(keys[i], key.size(), 0);
+		}
+	}
+	writer.flush();
+	return buffer;
+}
+
+static void testFieldOrder() {
+	static const char* const reversed[] = { "objectBMap", "objectBArray", "integer" };
+	static const char* const partly[] = { "integer", "objectBMap", "objectBArray" };
+	static const char* const unknown[] = { "integer", "unknown", "objectBArray", "objectBMap" };
+	static const char* const missing[] = { "objectBMap", "integer" };
+	ObjectA expected = sample(5);
+	std::string inOrder = packed(expected);
+	CHECK(reordered(partly, 3).size() == inOrder.size());
+	const std::string messages[] = { reordered(reversed, 3), reordered(partly, 3) };
+	for (const std::string& message : messages) {
+		ObjectA a;
+		a.unpack(message.data(), message.size());
+		CHECK(packed(a) == inOrder);
+	}
+	CHECK(!unpacks(reordered(unknown, 4)));
+	std::string partial = reordered(missing, 2);
+	ObjectA a;
+	a.unpack(partial.data(), partial.size());
+	CHECK(a.integer == 5 && a.objectBArray.empty() && a.objectBMap.size() == 1);
+}
+
+int main() {
+	testMalformed();
+	testUtf8();
+	testLimits();
+	testUnpacker();
+	testStreambuf();
+	testMembers();
+	testBorrowed();
+#ifdef CA_MSGPACK_PMR
+	testPmr();
+#endif
+	testFieldOrder();
+	testSkipUnknown();
+	testPositional();
+	testWide();
+	testView();
+	testTimestamp();
+#ifdef CA_MSGPACK_MMAP
+	testMappedFile();
+#endif
+	testStreamWriter();
+	testBatch();
+	if (failures != 0) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}